@@ -47,22 +47,13 @@ int exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
   struct elfhdr elf;
-  struct dirent *ep;
+  struct dirent *ep, *exe = 0, *oldexe;
+  struct seg seg[NSEG];
+  int nseg = 0;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  pagetable_t kpagetable = 0, oldkpagetable;
   struct proc *p = myproc();
 
-  // Make a copy of p->kpt without old user space, 
-  // but with the same kstack we are using now, which can't be changed
-  if ((kpagetable = (pagetable_t)kalloc()) == NULL) {
-    return -1;
-  }
-  memmove(kpagetable, p->kpagetable, PGSIZE);
-  for (int i = 0; i < PX(2, MAXUVA); i++) {
-    kpagetable[i] = 0;
-  }
-
   if((ep = ename(path)) == NULL) {
     #ifdef DEBUG
     printf("[exec] %s not found\n", path);
@@ -78,8 +69,11 @@ int exec(char *path, char **argv)
     goto bad;
   if((pagetable = proc_pagetable(p)) == NULL)
     goto bad;
+  // with the same kstack we are using now, which can't be changed
+  pagetable[PX(2, VKSTACK)] = p->pagetable[PX(2, VKSTACK)];
 
-  // Load program into memory.
+  // Record the segments, for pagefault() to read in as they are
+  // touched; load any past the first NSEG now.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(eread(ep, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -89,17 +83,32 @@ int exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if(ph.vaddr % PGSIZE != 0)
+      goto bad;
+    if(nseg < NSEG){
+      seg[nseg].va = ph.vaddr;
+      seg[nseg].fend = ph.vaddr + ph.filesz;
+      seg[nseg].end = ph.vaddr + ph.memsz;
+      seg[nseg].off = ph.off;
+      seg[nseg].perm = PTE_R;
+      if(ph.flags & ELF_PROG_FLAG_WRITE)
+        seg[nseg].perm |= PTE_W;
+      if(ph.flags & ELF_PROG_FLAG_EXEC)
+        seg[nseg].perm |= PTE_X;
+      nseg++;
+      if(ph.vaddr + ph.memsz > sz)
+        sz = ph.vaddr + ph.memsz;
+      continue;
+    }
     uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, kpagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     sz = sz1;
-    if(ph.vaddr % PGSIZE != 0)
-      goto bad;
     if(loadseg(pagetable, ph.vaddr, ep, ph.off, ph.filesz) < 0)
       goto bad;
   }
   eunlock(ep);
-  eput(ep);
+  exe = ep;
   ep = 0;
 
   p = myproc();
@@ -109,7 +118,7 @@ int exec(char *path, char **argv)
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
   uint64 sz1;
-  if((sz1 = uvmalloc(pagetable, kpagetable, sz, sz + 2*PGSIZE)) == 0)
+  if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   sz = sz1;
   uvmclear(pagetable, sz-2*PGSIZE);
@@ -151,29 +160,35 @@ int exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
-  oldkpagetable = p->kpagetable;
   p->pagetable = pagetable;
-  p->kpagetable = kpagetable;
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
-  w_satp(MAKE_SATP(p->kpagetable));
+  oldexe = p->exe;
+  p->exe = exe;
+  memmove(p->seg, seg, sizeof(seg));
+  p->nseg = nseg;
+  w_satp(MAKE_SATP(p->pagetable));
   sfence_vma();
-  kvmfree(oldkpagetable, 0);
+  // leaves the old memory to any threads still sharing it.
+  proc_freeuvm(p, oldpagetable, oldsz, 0);
+  if(oldexe)
+    eput(oldexe);
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
   #ifdef DEBUG
   printf("[exec] reach bad\n");
   #endif
-  if(pagetable)
+  if(pagetable){
+    pagetable[PX(2, VKSTACK)] = 0;
     proc_freepagetable(pagetable, sz);
-  if(kpagetable)
-    kvmfree(kpagetable, 0);
+  }
   if(ep){
     eunlock(ep);
     eput(ep);
   }
+  if(exe)
+    eput(exe);
   return -1;
 }
@@ -10,6 +10,8 @@
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/vm.h"
+#include "include/kalloc.h"
+#include "include/pcache.h"
 
 /* fields that start with "_" are something we don't use */
 
@@ -68,14 +70,72 @@ static struct
 
 } fat;
 
+#define EHASH_NUM 64 // dcache buckets, a power of two
+#define ENEGATIVE 2  // dirent::valid of a cached failed lookup
+
+// A valid entry is found through the bucket of (parent, hash of filename).
+// A failed lookup leaves a negative entry (valid == ENEGATIVE) in the bucket, which
+// pins nothing and goes away when the name is created or the slot is reclaimed.
+// Each bucket lock guards its chain; ecache.lock still guards ref and the LRU list.
+// Lock order: bucket lock, then ecache.lock.
+struct ebucket
+{
+    struct spinlock lock;
+    struct dirent *head;
+};
+
+// Entries are carved out of whole pages, allocated as the cache grows and
+// given back by ecacheshrink() when kalloc() runs out.
+struct epage
+{
+    struct epage *next;
+    struct dirent entries[];
+};
+
+#define EPAGE_NENT ((PGSIZE - sizeof(struct epage)) / sizeof(struct dirent))
+
 static struct entry_cache
 {
     struct spinlock lock;
-    struct dirent entries[ENTRY_CACHE_NUM];
+    struct epage *pages;
+    int nentry;
+    struct ebucket buckets[EHASH_NUM];
 } ecache;
 
+// Name index of a large directory, hanging off its dirent and guarded by its lock.
+// Built once a lookup has scanned DINDEX_MIN entries; maps the hash of each name
+// to the offset of the entry's first slot. Dropped under memory pressure.
+#define DINDEX_MIN 32
+
+struct dinode
+{
+    uint32 hash;
+    uint32 off;
+    struct dinode *next;
+};
+
+struct dipage
+{
+    struct dipage *next;
+    struct dinode nodes[];
+};
+
+#define DIPAGE_NNODE ((PGSIZE - sizeof(struct dipage)) / sizeof(struct dinode))
+
+struct dindex
+{
+    uint32 end;           // offset just past the last entry, where new ones go
+    struct dipage *pages; // node storage
+    struct dinode *free;
+    struct dinode *buckets[];
+};
+
+#define DINDEX_NBUCKET ((PGSIZE - sizeof(struct dindex)) / sizeof(struct dinode *))
+
 static struct dirent root;
 
+static int ecacheshrink(void);
+
 /**
  * Read the Boot Parameter Block.
  * @return  0       if success
@@ -124,19 +184,14 @@ int fat32_init()
     root.valid = 1;
     root.prev = &root;
     root.next = &root;
-    for (struct dirent *de = ecache.entries; de < ecache.entries + ENTRY_CACHE_NUM; de++)
-    {
-        de->dev = 0;
-        de->valid = 0;
-        de->ref = 0;
-        de->dirty = 0;
-        de->parent = 0;
-        de->next = root.next;
-        de->prev = &root;
-        initsleeplock(&de->lock, "entry");
-        root.next->prev = de;
-        root.next = de;
+    ecache.pages = 0;
+    ecache.nentry = 0;
+    for (struct ebucket *b = ecache.buckets; b < ecache.buckets + EHASH_NUM; b++)
+    {
+        initlock(&b->lock, "ehash");
+        b->head = 0;
     }
+    kshrinker(ecacheshrink);
     return 0;
 }
 
@@ -338,9 +393,10 @@ static int reloc_clus(struct dirent *entry, uint off, int alloc)
     return off % fat.byts_per_clus;
 }
 
-/* like the original readi, but "reade" is odd, let alone "writee" */
+// Read n bytes of entry's data at off straight from disk, bypassing the
+// page cache, which fills its pages with this.
 // Caller must hold entry->lock.
-int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
+int eload(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
 {
     if (off > entry->file_size || off + n < off || (entry->attribute & ATTR_DIRECTORY))
     {
@@ -368,6 +424,46 @@ int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
     return tot;
 }
 
+/* like the original readi, but "reade" is odd, let alone "writee" */
+// Reads go through the page cache a page at a time, and only go to the
+// disk directly when it has no page to spare.
+// Caller must hold entry->lock.
+int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
+{
+    if (off > entry->file_size || off + n < off || (entry->attribute & ATTR_DIRECTORY))
+    {
+        return 0;
+    }
+    if (off + n > entry->file_size)
+    {
+        n = entry->file_size - off;
+    }
+
+    uint tot, m;
+    char *pg;
+    for (tot = 0; tot < n; tot += m, off += m, dst += m)
+    {
+        m = PGSIZE - off % PGSIZE;
+        if (n - tot < m)
+        {
+            m = n - tot;
+        }
+        if ((pg = pcget(entry, off - off % PGSIZE)) == 0)
+        {
+            return tot + eload(entry, user_dst, dst, off, n - tot);
+        }
+        int bad = either_copyout(user_dst, dst, pg + off % PGSIZE, m);
+        kfree(pg);
+        if (bad)
+        {
+            break;
+        }
+    }
+    return tot;
+}
+
+// Writes go through to the disk, updating any cached copy of the page
+// on the way so that readers and mappings of it see them at once.
 // Caller must hold entry->lock.
 int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
 {
@@ -382,16 +478,34 @@ int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
         entry->dirty = 1;
     }
     uint tot, m;
+    char *pg;
     for (tot = 0; tot < n; tot += m, off += m, src += m)
     {
         reloc_clus(entry, off, 1);
         m = fat.byts_per_clus - off % fat.byts_per_clus;
+        if (PGSIZE - off % PGSIZE < m)
+        {
+            m = PGSIZE - off % PGSIZE;
+        }
         if (n - tot < m)
         {
             m = n - tot;
         }
-        if (rw_clus(entry->cur_clus, 1, user_src, src, off % fat.byts_per_clus, m) != m)
+        if ((pg = pclookup(entry, off - off % PGSIZE)) == 0)
         {
+            if (rw_clus(entry->cur_clus, 1, user_src, src, off % fat.byts_per_clus, m) != m)
+            {
+                break;
+            }
+            continue;
+        }
+        char *p = pg + off % PGSIZE;
+        int ok = either_copyin(p, user_src, src, m) == 0 &&
+                 rw_clus(entry->cur_clus, 1, 0, (uint64)p, off % fat.byts_per_clus, m) == m;
+        kfree(pg);
+        if (!ok)
+        { // the page may now hold what never reached the disk
+            pcinval(entry, off, m);
             break;
         }
     }
@@ -406,46 +520,385 @@ int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
     return tot;
 }
 
+// FNV-1a over the name, at most FAT32_MAX_FILENAME bytes.
+static uint32 ehashname(char *name)
+{
+    uint32 h = 2166136261u;
+    for (int i = 0; i < FAT32_MAX_FILENAME && name[i]; i++)
+    {
+        h ^= (uint8)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct ebucket *ebucketof(struct dirent *parent, uint32 hash)
+{
+    uint32 h = hash ^ ((uint32)((uint64)parent >> 4) * 2654435761u);
+    return &ecache.buckets[(h ^ (h >> 16)) & (EHASH_NUM - 1)];
+}
+
+// Link entry into the bucket of (entry->parent, entry->filename) with the given
+// valid state, first dropping any negative entry for the same name.
+static void elink(struct dirent *entry, short valid)
+{
+    entry->hash = ehashname(entry->filename);
+    struct ebucket *b = ebucketof(entry->parent, entry->hash);
+    acquire(&b->lock);
+    for (struct dirent **pp = &b->head; *pp != 0;)
+    {
+        struct dirent *ep = *pp;
+        if (ep->valid == ENEGATIVE && ep->hash == entry->hash && ep->parent == entry->parent &&
+            strncmp(ep->filename, entry->filename, FAT32_MAX_FILENAME) == 0)
+        {
+            *pp = ep->hnext;
+            ep->hnext = 0;
+            ep->valid = 0;
+        }
+        else
+        {
+            pp = &ep->hnext;
+        }
+    }
+    entry->hnext = b->head;
+    b->head = entry;
+    entry->valid = valid;
+    release(&b->lock);
+}
+
+// Make entry valid and visible to eget() under (entry->parent, entry->filename).
+// Caller should hold entry->parent->lock, so the same name is not hashed twice.
+void ehash(struct dirent *entry)
+{
+    elink(entry, 1);
+}
+
+// Take entry off its bucket, if it is on one. The bucket is found by the cached
+// hash, so this works even after filename has been overwritten.
+static void eunhash(struct dirent *entry)
+{
+    struct ebucket *b = ebucketof(entry->parent, entry->hash);
+    acquire(&b->lock);
+    for (struct dirent **pp = &b->head; *pp != 0; pp = &(*pp)->hnext)
+    {
+        if (*pp == entry)
+        {
+            *pp = entry->hnext;
+            entry->hnext = 0;
+            break;
+        }
+    }
+    release(&b->lock);
+}
+
+// Whether a negative entry says parent has no file called name.
+static int enegative(struct dirent *parent, char *name)
+{
+    uint32 hash = ehashname(name);
+    struct ebucket *b = ebucketof(parent, hash);
+    int found = 0;
+    acquire(&b->lock);
+    for (struct dirent *ep = b->head; ep != 0; ep = ep->hnext)
+    {
+        if (ep->valid == ENEGATIVE && ep->hash == hash && ep->parent == parent &&
+            strncmp(ep->filename, name, FAT32_MAX_FILENAME) == 0)
+        {
+            found = 1;
+            break;
+        }
+    }
+    release(&b->lock);
+    return found;
+}
+
+static void eindexfree(struct dirent *dp)
+{
+    struct dindex *di = dp->index;
+    if (di == 0)
+    {
+        return;
+    }
+    dp->index = 0;
+    for (struct dipage *pg = di->pages, *next; pg != 0; pg = next)
+    {
+        next = pg->next;
+        kfree(pg);
+    }
+    kfree(di);
+}
+
+// Record that an entry hashing to hash starts at off. Returns -1 without memory.
+static int eindexadd(struct dindex *di, uint32 hash, uint32 off)
+{
+    if (di->free == 0)
+    {
+        struct dipage *pg = kalloc();
+        if (pg == 0)
+        {
+            return -1;
+        }
+        pg->next = di->pages;
+        di->pages = pg;
+        for (int i = 0; i < DIPAGE_NNODE; i++)
+        {
+            pg->nodes[i].next = di->free;
+            di->free = &pg->nodes[i];
+        }
+    }
+    struct dinode *n = di->free;
+    di->free = n->next;
+    n->hash = hash;
+    n->off = off;
+    n->next = di->buckets[hash % DINDEX_NBUCKET];
+    di->buckets[hash % DINDEX_NBUCKET] = n;
+    return 0;
+}
+
+static void eindexdel(struct dindex *di, uint32 hash, uint32 off)
+{
+    for (struct dinode **pp = &di->buckets[hash % DINDEX_NBUCKET]; *pp != 0; pp = &(*pp)->next)
+    {
+        if ((*pp)->off == off)
+        {
+            struct dinode *n = *pp;
+            *pp = n->next;
+            n->next = di->free;
+            di->free = n;
+            return;
+        }
+    }
+}
+
+// Index every entry of dp, using ep (not valid) as scratch. Gives up quietly
+// if memory runs out. Caller must hold dp->lock.
+static void eindexbuild(struct dirent *dp, struct dirent *ep)
+{
+    struct dindex *di = kalloc();
+    if (di == 0)
+    {
+        return;
+    }
+    memset(di, 0, PGSIZE);
+    dp->index = di;
+    int type, count = 0;
+    uint off = 0;
+    while ((type = enext(dp, ep, off, &count)) != -1)
+    {
+        if (type == 1 && eindexadd(di, ehashname(ep->filename), off) < 0)
+        {
+            eindexfree(dp);
+            return;
+        }
+        off += count << 5;
+    }
+    di->end = off;
+}
+
+// Look filename up in dp's index, reading the candidates into ep to compare
+// names. Sets *poff to the entry's offset if found, else to where a new one goes.
+// Caller must hold dp->lock.
+static int eindexfind(struct dirent *dp, struct dirent *ep, char *filename, uint *poff)
+{
+    struct dindex *di = dp->index;
+    uint32 hash = ehashname(filename);
+    int count;
+    for (struct dinode *n = di->buckets[hash % DINDEX_NBUCKET]; n != 0; n = n->next)
+    {
+        if (n->hash == hash && enext(dp, ep, n->off, &count) == 1 &&
+            strncmp(filename, ep->filename, FAT32_MAX_FILENAME) == 0)
+        {
+            *poff = n->off;
+            return 1;
+        }
+    }
+    *poff = di->end;
+    return 0;
+}
+
+// Least recently used unreferenced entry, or 0. Caller must hold ecache.lock.
+static struct dirent *elru(void)
+{
+    for (struct dirent *ep = root.prev; ep != &root; ep = ep->prev)
+    {
+        if (ep->ref == 0)
+        {
+            return ep;
+        }
+    }
+    return 0;
+}
+
+// Take an unreferenced entry away from the cache, leaving it for the caller
+// to eunhash() once ecache.lock is dropped. Caller must hold ecache.lock.
+static void eclaim(struct dirent *ep)
+{
+    ep->ref = 1;
+    ep->valid = 0;
+    eindexfree(ep);
+    if (ep->attribute & ATTR_DIRECTORY)
+    { // unreferenced children still name ep as their parent, and
+      // would be found under whatever directory ep becomes next
+        for (struct dirent *c = root.next; c != &root; c = c->next)
+        {
+            if (c->parent == ep && c->ref == 0)
+            {
+                c->valid = 0;
+            }
+        }
+    }
+}
+
+// Add a page of free entries at the cold end of the LRU list.
+static int egrow(void)
+{
+    struct epage *pg = kalloc();
+    if (pg == 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < EPAGE_NENT; i++)
+    {
+        struct dirent *de = &pg->entries[i];
+        memset(de, 0, sizeof(*de));
+        initsleeplock(&de->lock, "entry");
+    }
+    acquire(&ecache.lock);
+    for (int i = 0; i < EPAGE_NENT; i++)
+    {
+        struct dirent *de = &pg->entries[i];
+        de->prev = root.prev;
+        de->next = &root;
+        root.prev->next = de;
+        root.prev = de;
+    }
+    pg->next = ecache.pages;
+    ecache.pages = pg;
+    ecache.nentry += EPAGE_NENT;
+    release(&ecache.lock);
+    return 0;
+}
+
+// Give back every page whose entries are all unreferenced, and the
+// indexes of directories nobody has locked. Called by kalloc() when
+// memory runs out.
+static int ecacheshrink(void)
+{
+    struct epage *pg, **pp, *freed = 0;
+    int n = 0;
+
+    acquire(&ecache.lock);
+    for (struct dirent *de = root.next; de != &root; de = de->next)
+    {
+        if (de->index == 0)
+        {
+            continue;
+        }
+        // the index is only used with de->lock held, and taking that
+        // needs lock.lk, so it is idle while we hold lk and see it free.
+        acquire(&de->lock.lk);
+        if (!de->lock.locked)
+        {
+            for (struct dipage *ip = de->index->pages; ip != 0; ip = ip->next)
+            {
+                n++;
+            }
+            eindexfree(de);
+            n++;
+        }
+        release(&de->lock.lk);
+    }
+    for (pp = &ecache.pages; (pg = *pp) != 0;)
+    {
+        int i;
+        for (i = 0; i < EPAGE_NENT && pg->entries[i].ref == 0; i++)
+            ;
+        if (i < EPAGE_NENT)
+        {
+            pp = &pg->next;
+            continue;
+        }
+        for (i = 0; i < EPAGE_NENT; i++)
+        {
+            struct dirent *de = &pg->entries[i];
+            eclaim(de);
+            de->next->prev = de->prev;
+            de->prev->next = de->next;
+        }
+        *pp = pg->next;
+        pg->next = freed;
+        freed = pg;
+        ecache.nentry -= EPAGE_NENT;
+    }
+    release(&ecache.lock);
+
+    while ((pg = freed) != 0)
+    {
+        freed = pg->next;
+        for (int i = 0; i < EPAGE_NENT; i++)
+        {
+            eunhash(&pg->entries[i]);
+        }
+        kfree(pg);
+        n++;
+    }
+    return n;
+}
+
 // Returns a dirent struct. If name is given, check ecache. It is difficult to cache entries
 // by their whole path. But when parsing a path, we open all the directories through it,
 // which forms a linked list from the final file to the root. Thus, we use the "parent" pointer
 // to recognize whether an entry with the "name" as given is really the file we want in the right path.
 // Should never get root by eget, it's easy to understand.
+// Returns 0 only when every entry is referenced and the cache can't grow.
 static struct dirent *eget(struct dirent *parent, char *name)
 {
     struct dirent *ep;
-    acquire(&ecache.lock);
     if (name)
     {
-        for (ep = root.next; ep != &root; ep = ep->next)
-        { // LRU algo
-            if (ep->valid == 1 && ep->parent == parent && strncmp(ep->filename, name, FAT32_MAX_FILENAME) == 0)
+        uint32 hash = ehashname(name);
+        struct ebucket *b = ebucketof(parent, hash);
+        acquire(&b->lock);
+        for (ep = b->head; ep != 0; ep = ep->hnext)
+        {
+            if (ep->hash == hash && ep->parent == parent && strncmp(ep->filename, name, FAT32_MAX_FILENAME) == 0)
             {
-                if (ep->ref++ == 0)
+                acquire(&ecache.lock);
+                if (ep->valid == 1)
                 {
-                    ep->parent->ref++;
+                    if (ep->ref++ == 0)
+                    {
+                        ep->parent->ref++;
+                    }
+                    release(&ecache.lock);
+                    release(&b->lock);
+                    return ep;
                 }
-                release(&ecache.lock);
-                // edup(ep->parent);
-                return ep;
+                release(&ecache.lock); // negative, or being reclaimed
             }
         }
+        release(&b->lock);
     }
-    for (ep = root.prev; ep != &root; ep = ep->prev)
-    { // LRU algo
-        if (ep->ref == 0)
-        {
-            ep->ref = 1;
-            ep->dev = parent->dev;
-            ep->off = 0;
-            ep->valid = 0;
-            ep->dirty = 0;
-            release(&ecache.lock);
-            return ep;
-        }
+    acquire(&ecache.lock);
+    ep = elru();
+    if (ep == 0 || (ep->valid != 0 && ecache.nentry < ENTRY_CACHE_NUM))
+    { // rather grow than evict a cached entry, until the cache is big enough
+        release(&ecache.lock);
+        egrow();
+        acquire(&ecache.lock);
+        ep = elru();
     }
-    panic("eget: insufficient ecache");
-    return 0;
+    if (ep == 0)
+    { // every entry is in use and there is no memory for more
+        release(&ecache.lock);
+        return 0;
+    }
+    eclaim(ep);
+    release(&ecache.lock);
+    eunhash(ep);
+    ep->dev = parent->dev;
+    ep->off = 0;
+    ep->dirty = 0;
+    return ep;
 }
 
 // trim ' ' in the head and tail, '.' in head, and test legality
@@ -580,6 +1033,17 @@ void emake(struct dirent *dp, struct dirent *ep, uint off)
     else
     {
         int entcnt = (strlen(ep->filename) + CHAR_LONG_NAME - 1) / CHAR_LONG_NAME; // count of l-n-entries, rounds up
+        if (dp->index)
+        {
+            if (eindexadd(dp->index, ehashname(ep->filename), off) < 0)
+            {
+                eindexfree(dp);
+            }
+            else if (off + ((entcnt + 1) << 5) > dp->index->end)
+            {
+                dp->index->end = off + ((entcnt + 1) << 5);
+            }
+        }
         char shortname[CHAR_SHORT_NAME + 1];
         memset(shortname, 0, sizeof(shortname));
         generate_shortname(shortname, ep->filename);
@@ -653,7 +1117,10 @@ struct dirent *ealloc(struct dirent *dp, char *name, int attr)
     { // entry exists
         return ep;
     }
-    ep = eget(dp, name);
+    if ((ep = eget(dp, name)) == 0)
+    {
+        return NULL;
+    }
     elock(ep);
     ep->attribute = attr;
     ep->file_size = 0;
@@ -677,7 +1144,7 @@ struct dirent *ealloc(struct dirent *dp, char *name, int attr)
         ep->attribute |= ATTR_ARCHIVE;
     }
     emake(dp, ep, off);
-    ep->valid = 1;
+    ehash(ep);
     eunlock(ep);
     return ep;
 }
@@ -736,6 +1203,11 @@ void eremove(struct dirent *entry)
         off += 32;
         off2 = reloc_clus(entry->parent, off, 0);
     }
+    if (entry->parent->index)
+    {
+        eindexdel(entry->parent->index, entry->hash, entry->off);
+    }
+    eunhash(entry);
     entry->valid = -1;
 }
 
@@ -743,6 +1215,7 @@ void eremove(struct dirent *entry)
 // caller must hold entry->lock
 void etrunc(struct dirent *entry)
 {
+    pcinval(entry, 0, entry->file_size);
     for (uint32 clus = entry->first_clus; clus >= 2 && clus < FAT32_EOC;)
     {
         uint32 next = read_fat(clus);
@@ -797,11 +1270,12 @@ void eput(struct dirent *entry)
 
         // Once entry->ref decreases down to 0, we can't guarantee the entry->parent field remains unchanged.
         // Because eget() may take the entry away and write it.
+        // Nor the entry itself: once unreferenced, ecacheshrink() may free its page.
         struct dirent *eparent = entry->parent;
         acquire(&ecache.lock);
-        entry->ref--;
+        int ref = --entry->ref;
         release(&ecache.lock);
-        if (entry->ref == 0)
+        if (ref == 0)
         {
             eput(eparent);
         }
@@ -945,6 +1419,8 @@ int enext(struct dirent *dp, struct dirent *ep, uint off, int *count)
 /**
  * Seacher for the entry in a directory and return a structure. Besides, record the offset of
  * some continuous empty slots that can fit the length of filename.
+ * A miss without poff is remembered, so asking again costs a hash probe.
+ * Once a scan has passed DINDEX_MIN entries, dp gets an index that later lookups use instead.
  * Caller must hold entry->lock.
  * @param   dp          entry of a directory file
  * @param   filename    target filename
@@ -970,7 +1446,15 @@ struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
     {
         return NULL;
     }
+    if (poff == 0 && enegative(dp, filename))
+    {
+        return NULL;
+    }
     struct dirent *ep = eget(dp, filename);
+    if (ep == 0)
+    {
+        return NULL;
+    }
     if (ep->valid == 1)
     {
         return ep;
@@ -980,32 +1464,72 @@ struct dirent *dirlookup(struct dirent *dp, char *filename, uint *poff)
     int entcnt = (len + CHAR_LONG_NAME - 1) / CHAR_LONG_NAME + 1; // count of l-n-entries, rounds up. plus s-n-e
     int count = 0;
     int type;
+    int found = 0;
     uint off = 0;
-    reloc_clus(dp, 0, 0);
-    while ((type = enext(dp, ep, off, &count) != -1))
+    if (dp->index)
+    {
+        found = eindexfind(dp, ep, filename, &off);
+    }
+    else
     {
-        if (type == 0)
+        int nent = 0;
+        reloc_clus(dp, 0, 0);
+        while ((type = enext(dp, ep, off, &count) != -1))
         {
-            if (poff && count >= entcnt)
+            nent++;
+            if (type == 0)
             {
-                *poff = off;
-                poff = 0;
+                if (poff && count >= entcnt)
+                {
+                    *poff = off;
+                    poff = 0;
+                }
+            }
+            else if (strncmp(filename, ep->filename, FAT32_MAX_FILENAME) == 0)
+            {
+                found = 1;
+                break;
             }
+            off += count << 5;
         }
-        else if (strncmp(filename, ep->filename, FAT32_MAX_FILENAME) == 0)
-        {
-            ep->parent = edup(dp);
-            ep->off = off;
-            ep->valid = 1;
-            return ep;
+        if (nent >= DINDEX_MIN)
+        { // big enough to be worth an index; ep is scratch, so reread the match
+            eindexbuild(dp, ep);
+            if (found)
+            {
+                enext(dp, ep, off, &count);
+            }
         }
-        off += count << 5;
+    }
+    if (found)
+    {
+        ep->parent = edup(dp);
+        ep->off = off;
+        ehash(ep);
+        return ep;
     }
     if (poff)
     {
         *poff = off;
+        eput(ep);
+    }
+    else
+    { // callers with poff are about to create the name, so remember only plain misses
+        strncpy(ep->filename, filename, FAT32_MAX_FILENAME);
+        ep->filename[FAT32_MAX_FILENAME] = '\0';
+        ep->attribute = 0;
+        ep->parent = dp;
+        elink(ep, ENEGATIVE);
+        acquire(&ecache.lock);
+        ep->ref--;
+        ep->next->prev = ep->prev;
+        ep->prev->next = ep->next;
+        ep->next = root.next;
+        ep->prev = &root;
+        root.next->prev = ep;
+        root.next = ep;
+        release(&ecache.lock);
     }
-    eput(ep);
     return NULL;
 }
 
@@ -1038,8 +1562,43 @@ static char *skipelem(char *path, char *name)
     return path;
 }
 
+// Step from dp, which the caller holds a reference on, to its child called
+// name if the dcache has it. The reference on dp is traded for one on the
+// child under a single ecache.lock, and dp itself is never locked.
+// Returns 0, still holding dp, if the child isn't cached.
+static struct dirent *estep(struct dirent *dp, char *name)
+{
+    uint32 hash = ehashname(name);
+    struct ebucket *b = ebucketof(dp, hash);
+    acquire(&b->lock);
+    for (struct dirent *ep = b->head; ep != 0; ep = ep->hnext)
+    {
+        if (ep->hash == hash && ep->parent == dp && strncmp(ep->filename, name, FAT32_MAX_FILENAME) == 0)
+        {
+            acquire(&ecache.lock);
+            if (ep->valid == 1)
+            {
+                if (ep->ref++ == 0)
+                {
+                    dp->ref++;
+                }
+                dp->ref--; // ep now pins dp, so this was not the last reference
+                release(&ecache.lock);
+                release(&b->lock);
+                return ep;
+            }
+            release(&ecache.lock);
+        }
+    }
+    release(&b->lock);
+    return 0;
+}
+
 // FAT32 version of namex in xv6's original file system.
-static struct dirent *lookup_path(char *path, int parent, char *name)
+// A relative path starts from base, or from the cwd if base is 0.
+// Components the dcache knows about, present or absent, are resolved
+// without locking the directory; only a miss reads it with dirlookup().
+static struct dirent *lookup_path(struct dirent *base, char *path, int parent, char *name)
 {
     struct dirent *entry, *next;
     if (*path == '/')
@@ -1048,7 +1607,7 @@ static struct dirent *lookup_path(char *path, int parent, char *name)
     }
     else if (*path != '\0')
     {
-        entry = edup(myproc()->cwd);
+        entry = edup(base ? base : myproc()->cwd);
     }
     else
     {
@@ -1056,18 +1615,27 @@ static struct dirent *lookup_path(char *path, int parent, char *name)
     }
     while ((path = skipelem(path, name)) != 0)
     {
-        elock(entry);
+        // attribute is fixed before an entry becomes reachable, so no lock is needed
         if (!(entry->attribute & ATTR_DIRECTORY))
         {
-            eunlock(entry);
             eput(entry);
             return NULL;
         }
         if (parent && *path == '\0')
         {
-            eunlock(entry);
             return entry;
         }
+        if ((next = estep(entry, name)) != 0)
+        {
+            entry = next;
+            continue;
+        }
+        if (enegative(entry, name))
+        {
+            eput(entry);
+            return NULL;
+        }
+        elock(entry);
         if ((next = dirlookup(entry, name, 0)) == 0)
         {
             eunlock(entry);
@@ -1089,86 +1657,132 @@ static struct dirent *lookup_path(char *path, int parent, char *name)
 struct dirent *ename(char *path)
 {
     char name[FAT32_MAX_FILENAME + 1];
-    return lookup_path(path, 0, name);
+    return lookup_path(0, path, 0, name);
 }
 
 struct dirent *enameparent(char *path, char *name)
 {
-    return lookup_path(path, 1, name);
+    return lookup_path(0, path, 1, name);
+}
+
+struct dirent *enameat(struct dirent *base, char *path)
+{
+    char name[FAT32_MAX_FILENAME + 1];
+    return lookup_path(base, path, 0, name);
+}
+
+struct dirent *enameparentat(struct dirent *base, char *path, char *name)
+{
+    return lookup_path(base, path, 1, name);
 }
 
 /**
- * 获取指定目录下的所有目录项信息，填充到用户缓冲区，兼容 Linux getdents64。
+ * 从 *poff 处逐簇读取目录 dp，把目录项紧凑地填入用户缓冲区。
+ * 每次先在内核页中攒满一批，放开目录锁后再拷贝到用户空间，拷贝期间不持有任何锁。
  *
- * @param parent (struct dirent*): 目录的父目录项指针
+ * @param dp (struct dirent*): 目录项指针
+ * @param poff (uint*): 目录内偏移游标，返回时指向下一个未读的目录项
  * @param buf (uint64): 用户空间缓冲区地址
  * @param len (int): 缓冲区长度（字节数）
- * @return uint64: 实际写入的字节数，失败返回-1
+ * @param plus (int): 为0时写 linux_dirent64，否则写带大小和首簇号的 direntplus
+ * @return int: 实际写入的字节数，目录结束返回0；失败或缓冲区放不下一项时返回-1
  */
-uint64 getdents64(struct dirent *parent, uint64 buf, int len)
+static int ereaddir(struct dirent *dp, uint *poff, uint64 buf, int len, int plus)
 {
-    // 记录已写入的目录项数量
-    int count = 0;
-    // 单个目录项结构体长度
-    int dirlen = sizeof(struct dirall);
-    struct dirall label;
-    struct dirent *ep;
-
-    // 预设目录项的偏移和长度
-    label.off = dirlen;
-    label.reclen = dirlen;
-
-    // 记录当前已写入的总字节数
-    int written = 0;
-
-    // 加锁目录项缓存，保证遍历安全
-    acquire(&ecache.lock);
+    if (!(dp->attribute & ATTR_DIRECTORY) || len < 0)
+    {
+        return -1;
+    }
+    char *kbuf = kalloc();
+    if (kbuf == 0)
+    {
+        return -1;
+    }
 
-    // 遍历所有目录项，查找属于 parent 的有效目录项
-    for (ep = root.next; ep != &root; ep = ep->next)
+    struct dirent de;
+    int written = 0; // 已拷贝到用户空间的字节数
+    int full = 0;    // 用户缓冲区已满
+    int eod = 0;     // 已读到目录末尾
+    uint off = *poff;
+    while (!full && !eod)
     {
-        // 只处理有效且父目录为 parent 的目录项
-        if (ep->valid == 1 && ep->parent == parent)
+        int n = 0, count = 0, type;
+        elock(dp);
+        while (1)
         {
-            // 检查剩余缓冲区是否足够存放一个目录项
-            if (written + dirlen > len)
+            de.valid = 0;
+            if ((type = enext(dp, &de, off, &count)) == -1)
             {
-                // 缓冲区已满，返回已写入的字节数
-                release(&ecache.lock);
-                return written;
+                eod = 1;
+                break;
             }
-
-            // 填充目录项信息
-            label.inode = count; // 这里可根据实际 inode 号赋值
-            label.type = ep->attribute;
-            strncpy(label.name, ep->filename, FAT32_MAX_FILENAME);
-
-            // 如果目录项被引用，先加锁
-            if (ep->ref > 0)
-                elock(ep);
-
-            // 拷贝目录项到用户空间
-            if (copyout2(buf + written, (char *)&label, dirlen) < 0)
+            if (type == 0)
+            { // 跳过空闲的目录项
+                off += count << 5;
+                continue;
+            }
+            int namelen = strlen(de.filename);
+            int hdrlen = plus ? sizeof(struct direntplus) : sizeof(struct linux_dirent64);
+            int reclen = (hdrlen + namelen + 1 + 7) & ~7;
+            if (written + n + reclen > len)
             {
-                // 拷贝失败，解锁并返回错误
-                if (ep->ref > 0)
-                    eunlock(ep);
-                release(&ecache.lock);
-                return -1;
+                full = 1;
+                break;
             }
-
-            // 解锁目录项
-            if (ep->ref > 0)
-                eunlock(ep);
-
-            written += dirlen;
-            count++;
+            if (n + reclen > PGSIZE)
+            { // 本批已满，先拷贝出去
+                break;
+            }
+            int dtype = (de.attribute & ATTR_DIRECTORY) ? DT_DIR : DT_REG;
+            if (plus)
+            {
+                struct direntplus *d = (struct direntplus *)(kbuf + n);
+                d->d_off = off + (count << 5);
+                d->d_size = de.file_size;
+                d->d_clus = de.first_clus;
+                d->d_reclen = reclen;
+                d->d_type = dtype;
+                memmove(d->d_name, de.filename, namelen + 1);
+            }
+            else
+            {
+                struct linux_dirent64 *d = (struct linux_dirent64 *)(kbuf + n);
+                d->d_ino = (off >> 5) + 1; // FAT32 没有 inode，用目录内位置代替，保证非0
+                d->d_off = off + (count << 5);
+                d->d_reclen = reclen;
+                d->d_type = dtype;
+                memmove(d->d_name, de.filename, namelen + 1);
+            }
+            n += reclen;
+            off += count << 5;
+        }
+        eunlock(dp);
+        if (n > 0 && copyout2(buf + written, kbuf, n) < 0)
+        {
+            kfree(kbuf);
+            return written > 0 ? written : -1;
         }
+        written += n;
+        *poff = off;
     }
+    kfree(kbuf);
 
-    // 解锁目录项缓存
-    release(&ecache.lock);
-
-    // 返回实际写入的字节数
+    // 缓冲区连一项都放不下
+    if (full && written == 0)
+    {
+        return -1;
+    }
     return written;
 }
+
+// 兼容 Linux getdents64，记录格式为 linux_dirent64。
+int getdents64(struct dirent *dp, uint *poff, uint64 buf, int len)
+{
+    return ereaddir(dp, poff, buf, len, 0);
+}
+
+// 与 getdents64 相同，但每条记录还带有文件大小和首簇号，省去逐个 open/fstat。
+int readdirplus(struct dirent *dp, uint *poff, uint64 buf, int len)
+{
+    return ereaddir(dp, poff, buf, len, 1);
+}
@@ -16,6 +16,7 @@
 #include "include/printf.h"
 #include "include/string.h"
 #include "include/vm.h"
+#include "include/kalloc.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -23,6 +24,9 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+// one descriptor table per process at most; threads leave some spare.
+struct fdtable fdtables[NPROC];
+
 void
 fileinit(void)
 {
@@ -31,6 +35,8 @@ fileinit(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     memset(f, 0, sizeof(struct file));
   }
+  for(struct fdtable *t = fdtables; t < fdtables + NPROC; t++)
+    initlock(&t->lock, "fdtable");
   #ifdef DEBUG
   printf("fileinit\n");
   #endif
@@ -93,6 +99,102 @@ fileclose(struct file *f)
   }
 }
 
+// Allocate an empty descriptor table.
+struct fdtable*
+fdtalloc(void)
+{
+  struct fdtable *t;
+
+  acquire(&ftable.lock);
+  for(t = fdtables; t < fdtables + NPROC; t++){
+    if(t->ref == 0){
+      t->ref = 1;
+      release(&ftable.lock);
+      return t;
+    }
+  }
+  release(&ftable.lock);
+  return NULL;
+}
+
+// Increment ref count for descriptor table t.
+struct fdtable*
+fdtdup(struct fdtable *t)
+{
+  acquire(&ftable.lock);
+  if(t->ref < 1)
+    panic("fdtdup");
+  t->ref++;
+  release(&ftable.lock);
+  return t;
+}
+
+// Drop a reference to t, closing all its files with the last one.
+void
+fdtput(struct fdtable *t)
+{
+  struct file *f;
+
+  acquire(&ftable.lock);
+  if(t->ref < 1)
+    panic("fdtput");
+  if(t->ref > 1){
+    t->ref--;
+    release(&ftable.lock);
+    return;
+  }
+  release(&ftable.lock);
+
+  // nobody else can reach t now; it stays allocated until emptied.
+  for(int fd = 0; fd < NOFILE; fd++){
+    if((f = t->ofile[fd]) != NULL){
+      t->ofile[fd] = 0;
+      fileclose(f);
+    }
+  }
+  acquire(&ftable.lock);
+  t->ref = 0;
+  release(&ftable.lock);
+}
+
+// Look up descriptor fd of the current process, for the rest of the
+// system call. If the descriptor table is shared with CLONE_FILES
+// threads, any of which may close fd meanwhile, the file is held by a
+// reference of its own until fdrelease(). Returns 0 if fd isn't open.
+struct file*
+fdget(int fd)
+{
+  struct proc *p = myproc();
+  struct fdtable *t = p->fdt;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return NULL;
+  acquire(&t->lock);
+  f = t->ofile[fd];
+  // t->ref only rises above 1 through clone() by a thread using t,
+  // so reading it unlocked at worst takes a needless reference.
+  if(f && t->ref > 1){
+    if(p->nfhold == NFHOLD)
+      f = NULL;
+    else
+      p->fhold[p->nfhold++] = filedup(f);
+  }
+  release(&t->lock);
+  return f;
+}
+
+// Drop the references fdget() has taken; syscall() calls this once
+// each system call returns.
+void
+fdrelease(void)
+{
+  struct proc *p = myproc();
+
+  while(p->nfhold > 0)
+    fileclose(p->fhold[--p->nfhold]);
+}
+
 // Get metadata about file f.
 // addr is a user virtual address, pointing to a struct stat.
 int
@@ -113,6 +215,22 @@ filestat(struct file *f, uint64 addr)
   return -1;
 }
 
+// Write f's directory entry (size, first cluster) back to disk.
+int
+filesync(struct file *f)
+{
+  if(f->type != FD_ENTRY)
+    return -1;
+  if(f->ep->parent == NULL)  // the root has no entry of its own to write
+    return 0;
+  elock(f->ep);
+  elock(f->ep->parent);
+  eupdate(f->ep);
+  eunlock(f->ep->parent);
+  eunlock(f->ep);
+  return 0;
+}
+
 // Read from file f.
 // addr is a user virtual address.
 int
@@ -122,6 +240,7 @@ fileread(struct file *f, uint64 addr, int n)
 
   if(f->readable == 0)
     return -1;
+  prefault(addr, n);  // the copy below may run under a lock
 
   switch (f->type) {
     case FD_PIPE:
@@ -154,6 +273,7 @@ filewrite(struct file *f, uint64 addr, int n)
 
   if(f->writable == 0)
     return -1;
+  prefault(addr, n);
 
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
@@ -177,6 +297,64 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Read into or write from the iovcnt user buffers in iov. If off is
+// given, an FD_ENTRY file is accessed at *off, which is advanced, and
+// f->off is left alone; pipes and devices have no position then.
+// The entry lock is held across the whole vector so it lands as a
+// unit. Returns the number of bytes moved, or -1.
+int
+filerwv(struct file *f, struct iovec *iov, int iovcnt, int write, uint *off)
+{
+  int i, r = 0, tot = 0;
+  uint n;
+  uint64 sum = 0;
+
+  if(write ? f->writable == 0 : f->readable == 0)
+    return -1;
+  for(i = 0; i < iovcnt; i++)  // the total must fit the int result
+    if(iov[i].iov_len > 0x7fffffff || (sum += iov[i].iov_len) > 0x7fffffff)
+      return -1;
+
+  if(f->type != FD_ENTRY){
+    if(off)
+      return -1;
+    for(i = 0; i < iovcnt; i++){
+      n = iov[i].iov_len;
+      if(n == 0)
+        continue;
+      r = write ? filewrite(f, (uint64)iov[i].iov_base, n) : fileread(f, (uint64)iov[i].iov_base, n);
+      if(r > 0)
+        tot += r;
+      if(r != n)
+        break;
+    }
+    return (tot == 0 && r < 0) ? -1 : tot;
+  }
+
+  if(off == NULL)
+    off = &f->off;
+  for(i = 0; i < iovcnt; i++)
+    prefault((uint64)iov[i].iov_base, iov[i].iov_len);
+  elock(f->ep);
+  for(i = 0; i < iovcnt; i++){
+    n = iov[i].iov_len;
+    if(n == 0)
+      continue;
+    if(write)
+      r = ewrite(f->ep, 1, (uint64)iov[i].iov_base, *off, n);
+    else
+      r = eread(f->ep, 1, (uint64)iov[i].iov_base, *off, n);
+    if(r > 0){
+      *off += r;
+      tot += r;
+    }
+    if(r != n)
+      break;
+  }
+  eunlock(f->ep);
+  return (tot == 0 && r < 0) ? -1 : tot;
+}
+
 // Read from dir f.
 // addr is a user virtual address.
 int
@@ -206,4 +384,104 @@ dirnext(struct file *f, uint64 addr)
     return -1;
 
   return 1;
-}
\ No newline at end of file
+}
+
+// One end of a kernel-side transfer: a file and, for FD_ENTRY,
+// the offset to read or write at.
+struct fileio {
+  struct file *f;
+  uint *off;
+};
+
+// Copy from the kernel buffer *arg points at, advancing it.
+static int
+copyfrom(void *arg, char *dst, uint n)
+{
+  char **src = arg;
+
+  memmove(dst, *src, n);
+  *src += n;
+  return n;
+}
+
+// Read up to n bytes from io into kernel memory at dst.
+static int
+fileget(void *arg, char *dst, uint n)
+{
+  struct fileio *io = arg;
+  struct file *f = io->f;
+  int r = -1;
+
+  if(f->type == FD_DEVICE){
+    if(f->major >= 0 && f->major < NDEV && devsw[f->major].read)
+      r = devsw[f->major].read(0, (uint64)dst, n);
+  } else if(f->type == FD_ENTRY){
+    elock(f->ep);
+    if((r = eread(f->ep, 0, (uint64)dst, *io->off, n)) > 0)
+      *io->off += r;
+    eunlock(f->ep);
+  }
+  return r;
+}
+
+// Write n bytes from kernel memory at src to io.
+static int
+fileput(void *arg, char *src, uint n)
+{
+  struct fileio *io = arg;
+  struct file *f = io->f;
+  int r = -1;
+
+  if(f->type == FD_PIPE){
+    r = pipefill(f->pipe, copyfrom, &src, n);
+  } else if(f->type == FD_DEVICE){
+    if(f->major >= 0 && f->major < NDEV && devsw[f->major].write)
+      r = devsw[f->major].write(0, (uint64)src, n);
+  } else if(f->type == FD_ENTRY){
+    elock(f->ep);
+    if((r = ewrite(f->ep, 0, (uint64)src, *io->off, n)) > 0)
+      *io->off += r;
+    eunlock(f->ep);
+  }
+  return r;
+}
+
+// Move up to n bytes from in to out inside the kernel, for splice(),
+// tee() and sendfile(). inoff/outoff are the positions to use for
+// FD_ENTRY ends. A pipe end is read or written in place, so data
+// moving between a pipe and a file or the console is copied once,
+// straight between the ring and the buffer cache or device. Between
+// two non-pipe ends it goes through one kernel page. With peek set,
+// in must be a pipe and keeps its data.
+int
+filesplice(struct file *in, uint *inoff, struct file *out, uint *outoff, int n, int peek)
+{
+  struct fileio src = { in, inoff }, dst = { out, outoff };
+  char *buf;
+  int r, w, i;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_PIPE)
+    return pipedrain(in->pipe, fileput, &dst, n, peek);
+  if(peek)
+    return -1;
+  if(out->type == FD_PIPE)
+    return pipefill(out->pipe, fileget, &src, n);
+
+  if((buf = kalloc()) == NULL)
+    return -1;
+  for(i = 0, w = 0; i < n; i += w){
+    if((r = fileget(&src, buf, n - i < PGSIZE ? n - i : PGSIZE)) <= 0){
+      w = r;
+      break;
+    }
+    if((w = fileput(&dst, buf, r)) < r){
+      if(w > 0)
+        i += w;
+      break;
+    }
+  }
+  kfree(buf);
+  return (i == 0 && w < 0) ? -1 : i;
+}
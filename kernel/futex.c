@@ -0,0 +1,121 @@
+// Fast user-space mutexes: block on a word of user memory.
+//
+// A waiter is keyed by the physical address of the word, so threads
+// sharing memory through CLONE_VM meet on the same key whatever their
+// page tables. Waiters queue in FIFO order on one of FUTEX_HASH
+// buckets; each bucket's lock also orders the value check in
+// futexwait() against futexwake(), so a wakeup can't be lost.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/vm.h"
+#include "include/futex.h"
+
+#define FUTEX_HASH 32
+
+struct futexw {
+  uint64 key;           // physical address waited on
+  int woken;
+  struct futexw *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct futexw *head;  // lives on the waiters' kernel stacks
+} futexq[FUTEX_HASH];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < FUTEX_HASH; i++)
+    initlock(&futexq[i].lock, "futex");
+}
+
+// Return the key for the aligned int at uaddr, or 0 if it isn't mapped.
+static uint64
+futexkey(uint64 uaddr)
+{
+  uint64 pa;
+
+  if(uaddr % sizeof(int) != 0 || uaddr >= myproc()->sz)
+    return 0;
+  if((pa = walkaddr(myproc()->pagetable, uaddr)) == 0){
+    if(pagefault(uaddr, PTE_R) < 0)
+      return 0;
+    pa = walkaddr(myproc()->pagetable, uaddr);
+  }
+  return pa + uaddr % PGSIZE;
+}
+
+static int
+futexhash(uint64 key)
+{
+  return (key >> 2) % FUTEX_HASH;
+}
+
+// Sleep until woken by futexwake() on the same word, provided it
+// still holds val. Returns 0 when woken, -1 if the word differed,
+// uaddr is bad or the process was killed.
+int
+futexwait(uint64 uaddr, int val)
+{
+  struct futexw w, **pp;
+  uint64 key;
+  int cur;
+  struct proc *p = myproc();
+
+  if((key = futexkey(uaddr)) == 0)
+    return -1;
+  int h = futexhash(key);
+  acquire(&futexq[h].lock);
+  if(copyin2((char *)&cur, uaddr, sizeof(cur)) < 0 || cur != val){
+    release(&futexq[h].lock);
+    return -1;
+  }
+  w.key = key;
+  w.woken = 0;
+  w.next = 0;
+  for(pp = &futexq[h].head; *pp; pp = &(*pp)->next)
+    ;
+  *pp = &w;
+  while(!w.woken && !p->killed)
+    sleep(&w, &futexq[h].lock);
+  if(!w.woken){
+    for(pp = &futexq[h].head; *pp != &w; pp = &(*pp)->next)
+      ;
+    *pp = w.next;
+  }
+  release(&futexq[h].lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake up to n waiters on the word at uaddr, oldest first.
+// Returns how many were woken, or -1 if uaddr is bad.
+int
+futexwake(uint64 uaddr, int n)
+{
+  struct futexw *w, **pp;
+  uint64 key;
+  int woken = 0;
+
+  if((key = futexkey(uaddr)) == 0)
+    return -1;
+  int h = futexhash(key);
+  acquire(&futexq[h].lock);
+  for(pp = &futexq[h].head; *pp && woken < n; ){
+    w = *pp;
+    if(w->key != key){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  release(&futexq[h].lock);
+  return woken;
+}
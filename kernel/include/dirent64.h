@@ -0,0 +1,31 @@
+#ifndef __DIRENT64_H
+#define __DIRENT64_H
+
+#include "types.h"
+
+#define DT_DIR 4
+#define DT_REG 8
+
+// One record of getdents(), laid out as on Linux. d_reclen covers the
+// NUL-terminated name, rounded up to 8 bytes; d_off is the directory
+// offset that resumes the listing just after this record.
+struct linux_dirent64 {
+  uint64 d_ino;
+  uint64 d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+// One record of readdirplus(): a directory entry together with the
+// stat data FAT32 keeps in it, packed the same way.
+struct direntplus {
+  uint64 d_off;
+  uint32 d_size;
+  uint32 d_clus;           // first cluster, 0 for an empty file
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+#endif
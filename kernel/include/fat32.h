@@ -3,6 +3,7 @@
 
 #include "sleeplock.h"
 #include "stat.h"
+#include "dirent64.h"
 
 #define ATTR_READ_ONLY 0x01
 #define ATTR_HIDDEN 0x02
@@ -21,7 +22,7 @@
 
 #define FAT32_MAX_FILENAME 255
 #define FAT32_MAX_PATH 260
-#define ENTRY_CACHE_NUM 50
+#define ENTRY_CACHE_NUM 200 // entries the ecache grows to before it recycles cached ones
 
 struct dirent
 {
@@ -46,6 +47,9 @@ struct dirent
     int ref;
     uint32 off;            // offset in the parent dir entry, for writing convenience
     struct dirent *parent; // because FAT32 doesn't have such thing like inum, use this for cache trick
+    uint32 hash;           // hash of filename, cached for the dcache buckets
+    struct dirent *hnext;  // next entry in the same dcache bucket
+    struct dindex *index;  // name index of a large directory, or 0
     struct dirent *next;
     struct dirent *prev;
     struct sleeplock lock;
@@ -54,21 +58,13 @@ struct dirent
     uint64 ctime;
 };
 
-struct dirall
-{
-    uint64 inode;                      // 索引结点号
-    uint64 off;                        // 到下一个dirent的偏移
-    unsigned short reclen;             // 当前dirent的长度
-    unsigned char type;                // 文件类型
-    char name[FAT32_MAX_FILENAME + 1]; // 文件名
-};
-
 int fat32_init(void);
 struct dirent *dirlookup(struct dirent *entry, char *filename, uint *poff);
 char *formatname(char *name);
 void emake(struct dirent *dp, struct dirent *ep, uint off);
 struct dirent *ealloc(struct dirent *dp, char *name, int attr);
 struct dirent *edup(struct dirent *entry);
+void ehash(struct dirent *entry);
 void eupdate(struct dirent *entry);
 void etrunc(struct dirent *entry);
 void eremove(struct dirent *entry);
@@ -79,8 +75,12 @@ void eunlock(struct dirent *entry);
 int enext(struct dirent *dp, struct dirent *ep, uint off, int *count);
 struct dirent *ename(char *path);
 struct dirent *enameparent(char *path, char *name);
+struct dirent *enameat(struct dirent *base, char *path);
+struct dirent *enameparentat(struct dirent *base, char *path, char *name);
 int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n);
+int eload(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n);
 int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n);
-uint64 getdents64(struct dirent *parent, uint64 buf, int len);
+int getdents64(struct dirent *dp, uint *poff, uint64 buf, int len);
+int readdirplus(struct dirent *dp, uint *poff, uint64 buf, int len);
 
 #endif
\ No newline at end of file
@@ -7,4 +7,10 @@
 #define O_DIRECTORY 0x200000
 
 #define AT_FDCWD -100
-#define AT_REMOVEDIR 0x200
\ No newline at end of file
+#define AT_REMOVEDIR 0x200
+
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+
+#define F_SETPIPE_SZ 1031
+#define F_GETPIPE_SZ 1032
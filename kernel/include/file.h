@@ -1,6 +1,10 @@
 #ifndef __FILE_H
 #define __FILE_H
 
+#include "param.h"
+#include "spinlock.h"
+#include "uio.h"
+
 struct file {
   enum { FD_NONE, FD_PIPE, FD_ENTRY, FD_DEVICE } type;
   int ref; // reference count
@@ -12,6 +16,14 @@ struct file {
   short major;       // FD_DEVICE
 };
 
+// A process's open-file descriptors. Threads clone()d with
+// CLONE_FILES share one table by reference count.
+struct fdtable {
+  struct spinlock lock;  // protects ofile[] slot allocation
+  int ref;               // protected by ftable.lock
+  struct file *ofile[NOFILE];
+};
+
 // #define major(dev)  ((dev) >> 16 & 0xFFFF)
 // #define minor(dev)  ((dev) & 0xFFFF)
 // #define	mkdev(m,n)  ((uint)((m)<<16| (n)))
@@ -32,7 +44,15 @@ struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
+int             filesync(struct file*);
 int             filewrite(struct file*, uint64, int n);
 int             dirnext(struct file *f, uint64 addr);
+struct fdtable* fdtalloc(void);
+struct fdtable* fdtdup(struct fdtable*);
+void            fdtput(struct fdtable*);
+struct file*    fdget(int fd);
+void            fdrelease(void);
+int             filerwv(struct file *f, struct iovec *iov, int iovcnt, int write, uint *off);
+int             filesplice(struct file *in, uint *inoff, struct file *out, uint *outoff, int n, int peek);
 
 #endif
\ No newline at end of file
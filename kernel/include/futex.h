@@ -0,0 +1,10 @@
+#ifndef __FUTEX_H
+#define __FUTEX_H
+
+#include "types.h"
+
+void futexinit(void);
+int futexwait(uint64 uaddr, int val);
+int futexwake(uint64 uaddr, int n);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __IORING_H
+#define __IORING_H
+
+#include "types.h"
+
+// Batched system call ring, shared between a process and the kernel.
+// The process fills sq[] and advances sq_tail, then calls
+// ioring_enter(); the kernel runs every queued request in that one
+// trap, posting a cqe for each and advancing sq_head and cq_tail.
+// The process consumes cq[] and advances cq_head. Indices run freely
+// and are taken modulo IORING_ENTRIES.
+
+#define IORING_ENTRIES 64
+
+#define IORING_OP_NOP   0
+#define IORING_OP_READ  1  // fd, addr, len [, off]
+#define IORING_OP_WRITE 2  // fd, addr, len [, off]
+#define IORING_OP_OPEN  3  // addr = path, len = open mode; res = fd
+#define IORING_OP_CLOSE 4  // fd
+#define IORING_OP_FSYNC 5  // fd
+
+#define IOSQE_FIXED_OFF 0x1  // READ/WRITE at off, leaving the file offset alone
+
+struct io_sqe {
+  uint8 opcode;
+  uint8 flags;
+  uint16 pad;
+  int fd;
+  uint64 addr;
+  uint32 len;
+  uint32 off;
+  uint64 user_data;  // copied to the matching cqe
+};
+
+struct io_cqe {
+  uint64 user_data;
+  int res;           // the syscall's return value
+  uint32 pad;
+};
+
+struct io_ring {
+  uint32 sq_head;    // written by the kernel
+  uint32 sq_tail;    // written by the process
+  uint32 cq_head;    // written by the process
+  uint32 cq_tail;    // written by the kernel
+  struct io_sqe sq[IORING_ENTRIES];
+  struct io_cqe cq[IORING_ENTRIES];
+};
+
+#endif
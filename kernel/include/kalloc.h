@@ -5,7 +5,10 @@
 
 void*           kalloc(void);
 void            kfree(void *);
+void            kdup(void *);
+int             kcount(void *);
 void            kinit(void);
 uint64          freemem_amount(void);
+void            kshrinker(int (*fn)(void));
 
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef __KPROF_H
+#define __KPROF_H
+
+#include "types.h"
+
+// kprof() operations
+#define KPROF_START   0  // clear the buffers and start sampling
+#define KPROF_STOP    1  // stop sampling; what was recorded stays readable
+#define KPROF_READ    2  // take up to n recorded samples
+#define KPROF_DROPPED 3  // samples overwritten since the last start
+
+// One timer-interrupt sample.
+struct kprof_sample {
+  uint64 pc;    // interrupted sepc
+  int pid;      // 0 if the CPU was idle in the scheduler
+  short hart;
+  short user;   // pc is a user address of pid
+};
+
+void kprofinit(void);
+void kprof_tick(uint64 pc, int user);
+int kprofctl(int op, uint64 addr, int n);
+
+#endif
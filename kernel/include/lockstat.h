@@ -0,0 +1,21 @@
+#ifndef __LOCKSTAT_H
+#define __LOCKSTAT_H
+
+#include "types.h"
+
+#define LOCKSTAT_SPIN  0
+#define LOCKSTAT_SLEEP 1
+
+// Contention statistics of all the locks of one type sharing a name,
+// as lockstat() reports them. Times are r_time() ticks.
+struct lockstat {
+  char name[16];
+  int type;          // LOCKSTAT_SPIN or LOCKSTAT_SLEEP
+  uint64 acquires;
+  uint64 contended;  // acquisitions that found the lock held
+  uint64 spins;      // failed test-and-set rounds (spinlocks only)
+  uint64 waitticks;  // time spent waiting in contended acquisitions
+  uint64 holdticks;  // time from acquisition to release
+};
+
+#endif
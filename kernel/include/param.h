@@ -9,9 +9,13 @@
 #define NDEV 10                    // maximum major device number
 #define ROOTDEV 1                  // device number of file system root disk
 #define MAXARG 32                  // max exec arguments
+#define NSEG 4                     // max demand-loaded segments per program
+#define NFHOLD 4                   // files a syscall holds through a shared fd table
 #define MAXOPBLOCKS 10             // max # of blocks any FS op writes
 #define LOGSIZE (MAXOPBLOCKS * 3)  // max data blocks in on-disk log
 #define NBUF (MAXOPBLOCKS * 3)     // size of disk block cache
+#define NCPAGE 256                 // file pages the page cache can hold
+#define NSWAP 1024                 // pages of swap space in /swapfile
 #define FSSIZE 1000                // size of file system in blocks
 #define MAXPATH 260                // maximum file path name
 #define INTERVAL (390000000 / 200) // timer interrupt interval
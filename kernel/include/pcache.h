@@ -0,0 +1,12 @@
+#ifndef __PCACHE_H
+#define __PCACHE_H
+
+#include "types.h"
+#include "fat32.h"
+
+void            pcinit(void);
+char*           pcget(struct dirent *ep, uint off);
+char*           pclookup(struct dirent *ep, uint off);
+void            pcinval(struct dirent *ep, uint off, uint n);
+
+#endif
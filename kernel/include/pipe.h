@@ -2,23 +2,36 @@
 #define __PIPE_H
 
 #include "types.h"
+#include "riscv.h"
 #include "spinlock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+#define PIPE_MAXPAGES 16  // largest ring a pipe can be grown to, in pages
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int wbusy;      // pipefill() is writing the ring with lock released
+  int rbusy;      // pipedrain() is reading the ring with lock released
+  uint size;      // capacity of the ring in bytes
+  int npage;      // pages kalloc()ed for the ring, 0 while it lives in data[]
+  char *pages[PIPE_MAXPAGES];  // ring storage, PGSIZE bytes per page
+  char data[];    // default ring: the rest of this struct's page
 };
 
+// default capacity: whatever is left of the page holding struct pipe.
+#define PIPESIZE (PGSIZE - sizeof(struct pipe))
+
 int pipealloc(struct file **f0, struct file **f1);
 void pipeclose(struct pipe *pi, int writable);
 int pipewrite(struct pipe *pi, uint64 addr, int n);
 int piperead(struct pipe *pi, uint64 addr, int n);
+int pipegetsize(struct pipe *pi);
+int pipesetsize(struct pipe *pi, int size);
+int pipefill(struct pipe *pi, int (*fill)(void*, char*, uint), void *arg, int n);
+int pipedrain(struct pipe *pi, int (*drain)(void*, char*, uint), void *arg, int n, int peek);
 
-#endif
\ No newline at end of file
+#endif
@@ -37,6 +37,8 @@ struct cpu
   struct context context; // swtch() here to enter scheduler().
   int noff;               // Depth of push_off() nesting.
   int intena;             // Were interrupts enabled before push_off()?
+  pagetable_t pagetable;  // Page table scheduler() runs on, 0 for kernel_pagetable.
+  int ptfree;             // pagetable was freed by its owner while still in use here.
 };
 
 extern struct cpu cpus[NCPU];
@@ -50,6 +52,19 @@ enum procstate
   ZOMBIE
 };
 
+struct mm;
+
+// A PT_LOAD segment exec() left to be read in page by page as it is
+// first touched (see pagefault()).
+struct seg
+{
+  uint64 va;   // start, page-aligned
+  uint64 fend; // end of the part backed by the file
+  uint64 end;  // end of the segment; the bss past fend is zero-filled
+  uint off;    // file offset of va
+  int perm;    // PTE_R, PTE_W and PTE_X as the ELF flags ask
+};
+
 // Per-process state
 struct proc
 {
@@ -66,12 +81,19 @@ struct proc
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
-  pagetable_t kpagetable;      // Kernel page table
+  pagetable_t pagetable;       // User page table, mapping the kernel too
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct mm *mm;               // User memory shared with CLONE_VM threads, or 0
+  struct fdtable *fdt;         // Descriptor table, shared with CLONE_FILES threads
+  struct file **ofile;         // Open files, fdt->ofile
+  struct file *fhold[NFHOLD];  // Files fdget() holds for the current syscall
+  int nfhold;
   struct dirent *cwd;          // Current directory
+  struct dirent *exe;          // Executable the segments are read from
+  struct seg seg[NSEG];        // Segments of it not loaded yet
+  int nseg;
+  int atuser;                  // Preempted on the way back to user space
   char name[16];               // Process name (debugging)
   int tmask;                   // trace mask
   int stopped;                 // ever stops but does not inform parent
@@ -86,6 +108,12 @@ int fork(void);
 int growproc(int);
 pagetable_t proc_pagetable(struct proc *);
 void proc_freepagetable(pagetable_t, uint64);
+void proc_freeuvm(struct proc *, pagetable_t, uint64, int);
+uint64 growmmap(int);
+uint64 mmapfile(struct dirent *, uint, int);
+void munmapproc(uint64, int);
+int pagefault(uint64, int);
+void prefault(uint64, uint64);
 int kill(int);
 struct cpu *mycpu(void);
 struct cpu *getmycpu(void);
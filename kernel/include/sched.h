@@ -0,0 +1,13 @@
+#ifndef __SCHED_H
+#define __SCHED_H
+
+// clone() flags, shared with user space. The values are Linux's.
+#define CLONE_VM     0x00000100  // share the address space
+#define CLONE_FILES  0x00000400  // share the descriptor table
+
+// futex() operations, also Linux's.
+#define FUTEX_WAIT          0    // sleep while *uaddr == val
+#define FUTEX_WAKE          1    // wake up to val waiters on uaddr
+#define FUTEX_PRIVATE_FLAG  128  // accepted and ignored
+
+#endif
@@ -14,6 +14,10 @@ struct sleeplock {
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+  // For contention statistics, as in struct spinlock:
+  struct lockstat *stat;
+  uint64 t0;
 };
 
 void            acquiresleep(struct sleeplock*);
@@ -1,7 +1,10 @@
 #ifndef __SPINLOCK_H
 #define __SPINLOCK_H
 
+#include "types.h"
+
 struct cpu;
+struct lockstat;
 
 // Mutual exclusion lock.
 struct spinlock {
@@ -10,6 +13,10 @@ struct spinlock {
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For contention statistics:
+  struct lockstat *stat;  // Shared by all locks with this name, or 0.
+  uint64 t0;              // When it was acquired, in r_time() ticks.
 };
 
 // Initialize a spinlock 
@@ -27,4 +34,10 @@ void release(struct spinlock*);
 // Interrupts must be off 
 int holding(struct spinlock*);
 
+// Statistics entry for locks of this name and type
+struct lockstat *lockstat_find(char *name, int type);
+
+// Copy out up to n statistics entries, optionally clearing them
+int lockstat_copy(uint64 addr, int n, int reset);
+
 #endif
@@ -6,6 +6,8 @@
 int memcmp(const void *, const void *, uint);
 void *memmove(void *, const void *, uint);
 void *memset(void *, int, uint);
+void pagecopy(void *, const void *);
+void pagezero(void *);
 char *safestrcpy(char *, const char *, int);
 int strlen(const char *);
 int strncmp(const char *, const char *, uint);
@@ -15,5 +17,8 @@ void snstr(char *dst, wchar const *src, int len);
 int wcsncmp(wchar const *s1, wchar const *s2, int len);
 char *strchr(const char *s, char c);
 char *str_mycat(char *dest, const char *src, int max_len);
+#ifdef SELFTEST
+void stringtest(void);
+#endif
 
 #endif
\ No newline at end of file
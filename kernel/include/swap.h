@@ -0,0 +1,19 @@
+#ifndef __SWAP_H
+#define __SWAP_H
+
+#include "types.h"
+#include "riscv.h"
+
+// A user PTE whose page is out in swap: not valid, this software bit
+// set, the slot in the PPN field and the page's R/W/X/U bits kept.
+#define PTE_SWAP (1L << 8)
+#define SWAPPTE(slot, flags) (((uint64)(slot) << 10) | ((flags) & (PTE_R|PTE_W|PTE_X|PTE_U)) | PTE_SWAP)
+#define PTE2SLOT(pte) ((pte) >> 10)
+
+void            swapinit(void);
+int             swapout(int self, int want);
+char*           swapread(pte_t pte);
+void            swapdup(pte_t pte);
+void            swapput(pte_t pte);
+
+#endif
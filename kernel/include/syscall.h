@@ -20,5 +20,6 @@ int argint(int n, int *ip);
 int argaddr(int n, uint64 *ip);
 int argstr(int n, char *buf, int max);
 void syscall(void);
+void syscallinit(void);
 
 #endif
\ No newline at end of file
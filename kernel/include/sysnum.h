@@ -59,6 +59,12 @@
 #define SYS_dev 10086
 #define SYS_dup3 24
 #define SYS_readdir 2002
+#define SYS_fcntl 2003
+#define SYS_ioring_enter 2004
+#define SYS_syscallstat 2005
+#define SYS_kprof 2006
+#define SYS_lockstat 2007
+#define SYS_readdirplus 2008
 #define SYS_getcwd 17
 #define SYS_rename 26
 #define SYS_getppid 173
@@ -74,6 +80,17 @@
 #define SYS_mmap 222
 #define SYS_munmap 215
 #define SYS_shutdown 210
+#define SYS_readv 65
+#define SYS_writev 66
+#define SYS_pread 67
+#define SYS_pwrite 68
+#define SYS_preadv 69
+#define SYS_pwritev 70
+#define SYS_sendfile 71
+#define SYS_fsync 82
+#define SYS_futex 98
+#define SYS_splice 76
+#define SYS_tee 77
 
 // undefined
 
@@ -0,0 +1,22 @@
+#ifndef __SYSSTAT_H
+#define __SYSSTAT_H
+
+#include "types.h"
+
+#define SYSSTAT_NBUCKET 24  // buckets in a latency histogram
+
+// What syscallstat() reports for one system call. Latencies are in
+// r_time() ticks, timebase-counter units. hist[0] counts the calls
+// that finished within the tick they started in, and hist[i] those
+// that took [2^(i-1), 2^i) ticks. The last bucket also takes
+// everything slower.
+struct sysstat {
+  int num;          // system call number
+  char name[16];
+  uint64 count;     // calls that returned
+  uint64 ticks;     // total latency
+  uint64 max;       // slowest call
+  uint64 hist[SYSSTAT_NBUCKET];
+};
+
+#endif
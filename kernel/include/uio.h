@@ -0,0 +1,14 @@
+#ifndef __UIO_H
+#define __UIO_H
+
+#include "types.h"
+
+#define IOV_MAX 16  // max buffers per readv/writev
+
+// one buffer of a readv/writev vector, shared with user space.
+struct iovec {
+  void *iov_base;
+  uint64 iov_len;
+};
+
+#endif
@@ -26,6 +26,15 @@ struct {
   uint64 npage;
 } kmem;
 
+// references to each page beyond the one kalloc() hands out, for
+// pages mapped in several places at once; see kdup().
+static ushort kref[(PHYSTOP - KERNBASE) / PGSIZE];
+
+#define NSHRINKER 4
+
+// caches that can hand pages back when the free list runs dry.
+static int (*shrinkers[NSHRINKER])(void);
+
 void
 kinit()
 {
@@ -52,6 +61,8 @@ freerange(void *pa_start, void *pa_end)
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// A page kdup() has shared is only freed once
+// every reference to it is dropped.
 void
 kfree(void *pa)
 {
@@ -60,6 +71,14 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < kernel_end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(kref[((uint64)pa - KERNBASE) / PGSIZE] > 0){
+    kref[((uint64)pa - KERNBASE) / PGSIZE]--;
+    release(&kmem.lock);
+    return;
+  }
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
@@ -72,6 +91,57 @@ kfree(void *pa)
   release(&kmem.lock);
 }
 
+// Take another reference to the allocated page pa,
+// to be dropped by its own kfree().
+void
+kdup(void *pa)
+{
+  acquire(&kmem.lock);
+  if(++kref[((uint64)pa - KERNBASE) / PGSIZE] == 0)
+    panic("kdup");
+  release(&kmem.lock);
+}
+
+// How many references there are to the allocated page pa.
+int
+kcount(void *pa)
+{
+  return kref[((uint64)pa - KERNBASE) / PGSIZE] + 1;
+}
+
+// Register fn to be called when kalloc() finds no free page. fn
+// should kfree() what it can spare and return the number of pages it
+// gave back. It runs with whatever locks kalloc()'s caller holds, so
+// it must not take a lock a caller may hold, nor sleep unless it has
+// checked that the caller can (see swapreclaim()). Registration is
+// done by pcinit() at boot, and by fat32_init() and swapinit() in the
+// first process before it reaches user space, one at a time but while
+// other CPUs may already be in kalloc(): each slot is filled with one
+// store, which kshrink() sees either way.
+void
+kshrinker(int (*fn)(void))
+{
+  for(int i = 0; i < NSHRINKER; i++){
+    if(shrinkers[i] == 0){
+      __sync_synchronize();
+      shrinkers[i] = fn;
+      return;
+    }
+  }
+  panic("kshrinker");
+}
+
+// Ask the registered caches for pages; returns how many came back.
+static int
+kshrink(void)
+{
+  int n = 0;
+
+  for(int i = 0; i < NSHRINKER && shrinkers[i]; i++)
+    n += shrinkers[i]();
+  return n;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -79,14 +149,20 @@ void *
 kalloc(void)
 {
   struct run *r;
-
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r) {
-    kmem.freelist = r->next;
-    kmem.npage--;
+  int shrunk = 0;
+
+  for(;;){
+    acquire(&kmem.lock);
+    r = kmem.freelist;
+    if(r) {
+      kmem.freelist = r->next;
+      kmem.npage--;
+    }
+    release(&kmem.lock);
+    if(r || shrunk || kshrink() == 0)
+      break;
+    shrunk = 1;
   }
-  release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
@@ -0,0 +1,114 @@
+// Sampling profiler.
+//
+// While it is on, each timer interrupt records the interrupted pc,
+// with the pid and hart, into a ring of the CPU it landed on. A full
+// ring overwrites its oldest samples, and those count as dropped.
+// kprofctl(KPROF_READ) drains the rings oldest first, CPU by CPU.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/vm.h"
+#include "include/kprof.h"
+
+#define KPROF_NSAMPLE 2048  // ring size per CPU, in timer ticks
+
+static struct {
+  struct spinlock lock;
+  uint head, tail;      // samples [tail, head) are unread
+  uint64 dropped;
+  struct kprof_sample ring[KPROF_NSAMPLE];
+} kprofbuf[NCPU];
+
+static volatile int kprofon;
+
+void
+kprofinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kprofbuf[i].lock, "kprof");
+}
+
+// Called by devintr() for each timer interrupt, with interrupts off.
+// user says whether pc was interrupted in user mode.
+void
+kprof_tick(uint64 pc, int user)
+{
+  struct proc *p;
+  struct kprof_sample *s;
+  int id;
+
+  if(!kprofon)
+    return;
+  p = myproc();
+  id = cpuid();
+  acquire(&kprofbuf[id].lock);
+  if(kprofbuf[id].head - kprofbuf[id].tail == KPROF_NSAMPLE){
+    kprofbuf[id].tail++;
+    kprofbuf[id].dropped++;
+  }
+  s = &kprofbuf[id].ring[kprofbuf[id].head++ % KPROF_NSAMPLE];
+  s->pc = pc;
+  s->pid = p ? p->pid : 0;
+  s->hart = id;
+  s->user = user;
+  release(&kprofbuf[id].lock);
+}
+
+// Copy up to n samples to user address addr, a batch at a time so no
+// lock is held while touching user memory. Returns how many, or -1.
+static int
+kprofread(uint64 addr, int n)
+{
+  struct kprof_sample batch[32];
+  int got = 0, m;
+
+  for(int i = 0; i < NCPU; i++){
+    while(got < n){
+      acquire(&kprofbuf[i].lock);
+      for(m = 0; m < NELEM(batch) && got + m < n &&
+                 kprofbuf[i].tail != kprofbuf[i].head; m++)
+        batch[m] = kprofbuf[i].ring[kprofbuf[i].tail++ % KPROF_NSAMPLE];
+      release(&kprofbuf[i].lock);
+      if(m == 0)
+        break;
+      if(copyout2(addr + got * sizeof(batch[0]), (char *)batch, m * sizeof(batch[0])) < 0)
+        return -1;
+      got += m;
+    }
+  }
+  return got;
+}
+
+int
+kprofctl(int op, uint64 addr, int n)
+{
+  uint64 dropped = 0;
+
+  switch(op){
+  case KPROF_START:
+    kprofon = 0;
+    for(int i = 0; i < NCPU; i++){
+      acquire(&kprofbuf[i].lock);
+      kprofbuf[i].head = kprofbuf[i].tail = 0;
+      kprofbuf[i].dropped = 0;
+      release(&kprofbuf[i].lock);
+    }
+    kprofon = 1;
+    return 0;
+  case KPROF_STOP:
+    kprofon = 0;
+    return 0;
+  case KPROF_READ:
+    if(n < 0)
+      return -1;
+    return kprofread(addr, n);
+  case KPROF_DROPPED:
+    for(int i = 0; i < NCPU; i++)
+      dropped += kprofbuf[i].dropped;
+    return dropped;
+  }
+  return -1;
+}
@@ -16,6 +16,11 @@
 #include "include/vm.h"
 #include "include/disk.h"
 #include "include/buf.h"
+#include "include/pcache.h"
+#include "include/futex.h"
+#include "include/syscall.h"
+#include "include/kprof.h"
+#include "include/string.h"
 #ifndef QEMU
 #include "include/sdcard.h"
 #include "include/fpioa.h"
@@ -43,6 +48,9 @@ main(unsigned long hartid, unsigned long dtb_pa)
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    #ifdef SELFTEST
+    stringtest();    // check and time the mem* routines
+    #endif
     timerinit();     // init a lock for timer
     trapinithart();  // install kernel trap vector, including interrupt handler
     procinit();
@@ -54,7 +62,11 @@ main(unsigned long hartid, unsigned long dtb_pa)
     #endif 
     disk_init();
     binit();         // buffer cache
+    pcinit();        // file page cache
     fileinit();      // file table
+    futexinit();     // futex wait queues
+    syscallinit();   // syscall statistics slots
+    kprofinit();     // sampling profiler buffers
     userinit();      // first user process
     printf("hart 0 init done\n");
     
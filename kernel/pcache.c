@@ -0,0 +1,217 @@
+// Page cache.
+//
+// Holds whole 4096-byte pages of file data, keyed by the file's
+// first cluster and the page's offset into it. eread() and ewrite()
+// go through it, so hot files are served from memory, and the pages
+// are what exec() and mmap() map read-only into every process using
+// the file, rather than each getting a private copy (see pagefault()).
+//
+// Interface:
+// * pcget() returns a file page with a kalloc() reference for the
+//   caller, reading it in if it isn't cached.
+// * pclookup() returns it only if it is cached, for ewrite() to
+//   update in place.
+// * pcinval() drops cached pages a truncate makes stale.
+// A page stays in memory while the cache or any page table holds a
+// reference to it. Pages nobody else maps are given up in clock
+// order, to make room for others or when kalloc() runs dry.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/sleeplock.h"
+#include "include/fat32.h"
+#include "include/kalloc.h"
+#include "include/pcache.h"
+#include "include/string.h"
+
+#define PCHASH 64
+#define PCSHRINK 32   // pages the shrinker hands back at a time
+
+struct cpage {
+  uint clus;            // first cluster of the file, 0 if free
+  uint off;             // page-aligned offset into the file
+  char *pa;             // the data; one reference is the cache's
+  int used;             // touched since the clock hand last passed
+  struct cpage *next;   // hash chain, or free list
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NCPAGE];
+  struct cpage *bucket[PCHASH];
+  struct cpage *free;
+  int hand;             // clock hand, over page[]
+} pcache;
+
+static int pcshrink(void);
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  for(int i = 0; i < NCPAGE; i++){
+    pcache.page[i].next = pcache.free;
+    pcache.free = &pcache.page[i];
+  }
+  kshrinker(pcshrink);
+}
+
+static struct cpage **
+pcbucket(uint clus, uint off)
+{
+  return &pcache.bucket[(clus * 31 + off / PGSIZE) % PCHASH];
+}
+
+// The link pointing at the page of (clus, off), or at the null
+// ending its chain if it isn't cached. Caller must hold pcache.lock.
+static struct cpage **
+pcfind(uint clus, uint off)
+{
+  struct cpage **pp;
+
+  for(pp = pcbucket(clus, off); *pp; pp = &(*pp)->next)
+    if((*pp)->clus == clus && (*pp)->off == off)
+      break;
+  return pp;
+}
+
+// Unlink the page *pp points at and drop the cache's reference.
+// Caller must hold pcache.lock.
+static void
+pcdrop(struct cpage **pp)
+{
+  struct cpage *c = *pp;
+
+  *pp = c->next;
+  kfree(c->pa);
+  c->clus = 0;
+  c->pa = 0;
+  c->next = pcache.free;
+  pcache.free = c;
+}
+
+// Drop the least recently used page only the cache references: the
+// clock hand sweeps the pages, sparing once each one touched since
+// it last passed. Returns 0 if there is none.
+// Caller must hold pcache.lock.
+static int
+pcevict(void)
+{
+  struct cpage *c;
+
+  for(int i = 0; i < 2 * NCPAGE; i++){
+    c = &pcache.page[pcache.hand];
+    pcache.hand = (pcache.hand + 1) % NCPAGE;
+    if(c->clus == 0 || kcount(c->pa) > 1)  // free, or mapped somewhere
+      continue;
+    if(c->used){
+      c->used = 0;
+      continue;
+    }
+    pcdrop(pcfind(c->clus, c->off));
+    return 1;
+  }
+  return 0;
+}
+
+// Return the cached page at offset off (page-aligned) of ep's data,
+// with a reference for the caller to kfree(), or 0 if it isn't cached.
+char *
+pclookup(struct dirent *ep, uint off)
+{
+  struct cpage *c;
+  char *pa = 0;
+
+  if(ep->first_clus == 0)
+    return 0;
+  acquire(&pcache.lock);
+  if((c = *pcfind(ep->first_clus, off)) != 0){
+    c->used = 1;
+    pa = c->pa;
+    kdup(pa);
+  }
+  release(&pcache.lock);
+  return pa;
+}
+
+// Return the page at offset off (page-aligned) of ep's data, with a
+// reference for the caller to kfree(), or 0 if it can't be read in.
+// Bytes past the end of the file are zero. If the cache is full of
+// pages in use the caller gets a private copy.
+// Caller must hold ep->lock.
+char *
+pcget(struct dirent *ep, uint off)
+{
+  struct cpage *c;
+  char *mem;
+  int n;
+
+  if(ep->first_clus == 0 || off % PGSIZE || off >= ep->file_size)
+    return 0;
+  if((mem = pclookup(ep, off)) != 0)
+    return mem;
+
+  // ep->lock keeps writers out until the page is in the cache.
+  if((mem = kalloc()) == 0)
+    return 0;
+  if((n = eload(ep, 0, (uint64)mem, off, PGSIZE)) <= 0){
+    kfree(mem);
+    return 0;
+  }
+  memset(mem + n, 0, PGSIZE - n);
+
+  acquire(&pcache.lock);
+  if(pcache.free == 0)
+    pcevict();
+  if((c = pcache.free) != 0){
+    pcache.free = c->next;
+    c->clus = ep->first_clus;
+    c->off = off;
+    c->pa = mem;
+    c->used = 1;
+    c->next = *pcbucket(c->clus, off);
+    *pcbucket(c->clus, off) = c;
+    kdup(mem);
+  }
+  release(&pcache.lock);
+  return mem;
+}
+
+// Drop the cached pages of ep overlapping [off, off+n), which no
+// longer hold its data. Page tables still mapping them keep it.
+// Caller must hold ep->lock.
+void
+pcinval(struct dirent *ep, uint off, uint n)
+{
+  struct cpage **pp;
+  uint end = off + n < off ? ~0U : off + n;
+
+  if(ep->first_clus == 0 || n == 0)
+    return;
+  acquire(&pcache.lock);
+  for(int i = 0; i < PCHASH; i++){
+    for(pp = &pcache.bucket[i]; *pp; ){
+      if((*pp)->clus == ep->first_clus && (*pp)->off < end &&
+         (*pp)->off + PGSIZE > off)
+        pcdrop(pp);
+      else
+        pp = &(*pp)->next;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// kalloc() shrinker: give back up to PCSHRINK pages, coldest first.
+static int
+pcshrink(void)
+{
+  int n = 0;
+
+  acquire(&pcache.lock);
+  while(n < PCSHRINK && pcevict())
+    n++;
+  release(&pcache.lock);
+  return n;
+}
@@ -9,6 +9,20 @@
 #include "include/pipe.h"
 #include "include/kalloc.h"
 #include "include/vm.h"
+#include "include/string.h"
+
+// Return the address of byte pos (0 <= pos < size) of a ring stored
+// in pages, and through *len how many bytes are contiguous from there.
+static char *
+ringaddr(char **pages, uint size, uint pos, uint *len)
+{
+  uint off = pos % PGSIZE;
+
+  *len = PGSIZE - off;
+  if(*len > size - pos)
+    *len = size - pos;
+  return pages[pos / PGSIZE] + off;
+}
 
 int
 pipealloc(struct file **f0, struct file **f1)
@@ -25,6 +39,11 @@ pipealloc(struct file **f0, struct file **f1)
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->wbusy = 0;
+  pi->rbusy = 0;
+  pi->size = PIPESIZE;
+  pi->npage = 0;
+  pi->pages[0] = pi->data;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -59,6 +78,8 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(int i = 0; i < pi->npage; i++)
+      kfree(pi->pages[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
@@ -67,24 +88,39 @@ pipeclose(struct pipe *pi, int writable)
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
-  char ch;
+  int i = 0;
+  uint m, len;
+  char *dst;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+  while(i < n){
+    if(pi->nwrite == pi->nread + pi->size){  //DOC: pipewrite-full
       if(pi->readopen == 0 || pr->killed){
         release(&pi->lock);
         return -1;
       }
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
+      continue;
+    }
+    if(pi->wbusy){  // a pipefill() owns the free space
+      sleep(&pi->wbusy, &pi->lock);
+      continue;
     }
-    // if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-    if(copyin2(&ch, addr + i, 1) == -1)
+    // copy the largest contiguous run that fits: bounded by the free
+    // space, the end of the ring page and what is left of the request.
+    dst = ringaddr(pi->pages, pi->size, pi->nwrite % pi->size, &len);
+    m = pi->size - (pi->nwrite - pi->nread);
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    // if(copyin(pr->pagetable, dst, addr + i, m) == -1)
+    if(copyin2(dst, addr + i, m) == -1)
       break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    pi->nwrite += m;
+    i += m;
   }
   wakeup(&pi->nread);
   release(&pi->lock);
@@ -94,27 +130,237 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i = 0;
+  uint m, len;
+  char *src;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rbusy){  //DOC: pipe-empty
     if(pr->killed){
       release(&pi->lock);
       return -1;
     }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+    if(pi->rbusy)
+      sleep(&pi->rbusy, &pi->lock);
+    else
+      sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    // if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-    if(copyout2(addr + i, &ch, 1) == -1)
+  // one copy per contiguous run: up to a page or the end of the ring.
+  while(i < n && pi->nread != pi->nwrite){  //DOC: piperead-copy
+    src = ringaddr(pi->pages, pi->size, pi->nread % pi->size, &len);
+    m = pi->nwrite - pi->nread;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    // if(copyout(pr->pagetable, addr + i, src, m) == -1)
+    if(copyout2(addr + i, src, m) == -1)
       break;
+    pi->nread += m;
+    i += m;
+  }
+  // the capacity need not divide 2^32, so keep the counters
+  // below 2 * size rather than letting them wrap.
+  if(pi->nread >= pi->size){
+    pi->nread -= pi->size;
+    pi->nwrite -= pi->size;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
   return i;
 }
+
+int
+pipegetsize(struct pipe *pi)
+{
+  return pi->size;
+}
+
+// Resize pi's ring to hold at least size bytes, rounded up to whole
+// pages once it outgrows the default. Unread data moves to the front
+// of the new ring. Returns the new capacity, or -1 if size is out of
+// range, smaller than the data still buffered, or memory is short.
+int
+pipesetsize(struct pipe *pi, int size)
+{
+  char *pages[PIPE_MAXPAGES];
+  int npage, i;
+  uint cap, used, off, m, len, dlen;
+  char *src, *dst;
+
+  if(size < 0 || size > PIPE_MAXPAGES * PGSIZE)
+    return -1;
+  if(size <= PIPESIZE){
+    npage = 0;
+    cap = PIPESIZE;
+    pages[0] = pi->data;
+  } else {
+    npage = PGROUNDUP(size) / PGSIZE;
+    cap = npage * PGSIZE;
+  }
+  for(i = 0; i < npage; i++){
+    if((pages[i] = kalloc()) == NULL){
+      while(--i >= 0)
+        kfree(pages[i]);
+      return -1;
+    }
+  }
+
+  acquire(&pi->lock);
+  while(pi->wbusy || pi->rbusy){  // the ring is in use with lock released
+    if(pi->wbusy)
+      sleep(&pi->wbusy, &pi->lock);
+    else
+      sleep(&pi->rbusy, &pi->lock);
+  }
+  used = pi->nwrite - pi->nread;
+  if(cap == pi->size || used > cap){
+    release(&pi->lock);
+    for(i = 0; i < npage; i++)
+      kfree(pages[i]);
+    return used > cap ? -1 : cap;
+  }
+  for(off = 0; off < used; off += m){
+    src = ringaddr(pi->pages, pi->size, (pi->nread + off) % pi->size, &len);
+    dst = ringaddr(pages, cap, off, &dlen);
+    m = used - off;
+    if(m > len)
+      m = len;
+    if(m > dlen)
+      m = dlen;
+    memmove(dst, src, m);
+  }
+  for(i = 0; i < pi->npage; i++)
+    kfree(pi->pages[i]);
+  memmove(pi->pages, pages, (npage ? npage : 1) * sizeof(pages[0]));
+  pi->npage = npage;
+  pi->size = cap;
+  pi->nread = 0;
+  pi->nwrite = used;
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+  return cap;
+}
+
+// Write up to n bytes into pi straight from a kernel-side source,
+// for splice() and friends. fill(arg, dst, m) stores at most m bytes
+// at dst and returns how many, 0 at end of input or -1 on error.
+// It runs with pi->lock released, directly on the ring's free space;
+// wbusy keeps other writers and resizes off that space meanwhile.
+// Returns the number of bytes moved, or -1 if none could be.
+int
+pipefill(struct pipe *pi, int (*fill)(void*, char*, uint), void *arg, int n)
+{
+  int i = 0, r;
+  uint m, len;
+  char *dst;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pi->wbusy){
+    if(pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    sleep(&pi->wbusy, &pi->lock);
+  }
+  pi->wbusy = 1;
+  while(i < n){
+    if(pi->readopen == 0 || pr->killed){
+      if(i == 0)
+        i = -1;
+      break;
+    }
+    if(pi->nwrite == pi->nread + pi->size){
+      wakeup(&pi->nread);
+      sleep(&pi->nwrite, &pi->lock);
+      continue;
+    }
+    dst = ringaddr(pi->pages, pi->size, pi->nwrite % pi->size, &len);
+    m = pi->size - (pi->nwrite - pi->nread);
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    release(&pi->lock);
+    r = fill(arg, dst, m);
+    acquire(&pi->lock);
+    if(r <= 0){
+      if(r < 0 && i == 0)
+        i = -1;
+      break;
+    }
+    pi->nwrite += r;
+    i += r;
+    wakeup(&pi->nread);
+    if(r < m)  // source has nothing more for now
+      break;
+  }
+  pi->wbusy = 0;
+  wakeup(&pi->wbusy);
+  wakeup(&pi->nread);
+  release(&pi->lock);
+  return i;
+}
+
+// Hand up to n buffered bytes of pi to a kernel-side sink. Waits
+// for data like piperead(), then calls drain(arg, src, m) on each
+// contiguous run of the ring with pi->lock released; drain returns
+// how many bytes it took, or <= 0 to stop. With peek set the data
+// stays in the pipe (tee). Returns the number of bytes passed on.
+int
+pipedrain(struct pipe *pi, int (*drain)(void*, char*, uint), void *arg, int n, int peek)
+{
+  int i = 0, r;
+  uint m, len, pos;
+  char *src;
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rbusy){
+    if(pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    if(pi->rbusy)
+      sleep(&pi->rbusy, &pi->lock);
+    else
+      sleep(&pi->nread, &pi->lock);
+  }
+  pi->rbusy = 1;
+  pos = pi->nread;
+  while(i < n && pos != pi->nwrite){
+    src = ringaddr(pi->pages, pi->size, pos % pi->size, &len);
+    m = pi->nwrite - pos;
+    if(m > len)
+      m = len;
+    if(m > n - i)
+      m = n - i;
+    release(&pi->lock);
+    r = drain(arg, src, m);
+    acquire(&pi->lock);
+    if(r <= 0){
+      if(r < 0 && i == 0)
+        i = -1;
+      break;
+    }
+    pos += r;
+    i += r;
+    if(!peek){
+      pi->nread = pos;
+      wakeup(&pi->nwrite);
+    }
+    if(r < m)
+      break;
+  }
+  if(pi->nread >= pi->size){
+    pi->nread -= pi->size;
+    pi->nwrite -= pi->size;
+  }
+  pi->rbusy = 0;
+  wakeup(&pi->rbusy);
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+  return i;
+}
@@ -13,6 +13,9 @@
 #include "include/file.h"
 #include "include/trap.h"
 #include "include/vm.h"
+#include "include/sched.h"
+#include "include/pcache.h"
+#include "include/swap.h"
 
 struct cpu cpus[NCPU];
 
@@ -23,10 +26,25 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// User memory shared by the threads of a CLONE_VM group. What they
+// share are the level-1 page tables under the user slots of their
+// pagetables (see uvmshare()); each keeps its own root, trapframe
+// and kernel stack. The last one out frees the memory.
+struct mm {
+  struct spinlock lock;  // serializes growing and shrinking
+  int ref;               // protected by mmtab.lock
+};
+
+struct {
+  struct spinlock lock;
+  struct mm mm[NPROC];
+} mmtab;
+
 extern void forkret(void);
 extern void swtch(struct context *, struct context *);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static int proc_kstack(pagetable_t pagetable);
 
 extern char trampoline[]; // trampoline.S
 
@@ -53,6 +71,9 @@ void procinit(void)
   struct proc *p;
 
   initlock(&pid_lock, "nextpid");
+  initlock(&mmtab.lock, "mmtab");
+  for (int i = 0; i < NPROC; i++)
+    initlock(&mmtab.mm[i].lock, "mm");
   for (p = proc; p < &proc[NPROC]; p++)
   {
     initlock(&p->lock, "proc");
@@ -153,16 +174,18 @@ found:
     return NULL;
   }
 
-  // An empty user page table.
-  // And an identical kernel page table for this proc.
+  // An empty user page table, which the kernel runs on too,
+  // with a kernel stack for this proc.
   if ((p->pagetable = proc_pagetable(p)) == NULL ||
-      (p->kpagetable = proc_kpagetable()) == NULL)
+      proc_kstack(p->pagetable) < 0 ||
+      (p->fdt = fdtalloc()) == NULL)
   {
     freeproc(p);
     release(&p->lock);
     return NULL;
   }
 
+  p->ofile = p->fdt->ofile;
   p->kstack = VKSTACK;
 
   // Set up new context to start executing at forkret,
@@ -183,15 +206,13 @@ freeproc(struct proc *p)
   if (p->trapframe)
     kfree((void *)p->trapframe);
   p->trapframe = 0;
-  if (p->kpagetable)
-  {
-    kvmfree(p->kpagetable, 1);
-  }
-  p->kpagetable = 0;
-  if (p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
+  proc_freeuvm(p, p->pagetable, p->sz, 1);
   p->pagetable = 0;
   p->sz = 0;
+  if (p->fdt)
+    fdtput(p->fdt);
+  p->fdt = 0;
+  p->ofile = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -236,6 +257,23 @@ proc_pagetable(struct proc *p)
   return pagetable;
 }
 
+// Give pagetable a fresh kernel stack at VKSTACK.
+// Returns 0 on success, -1 if out of memory.
+static int
+proc_kstack(pagetable_t pagetable)
+{
+  char *pstack;
+
+  if ((pstack = kalloc()) == NULL)
+    return -1;
+  if (mappages(pagetable, VKSTACK, PGSIZE, (uint64)pstack, PTE_R | PTE_W) < 0)
+  {
+    kfree(pstack);
+    return -1;
+  }
+  return 0;
+}
+
 // Free a process's page table, and free the
 // physical memory it refers to.
 void proc_freepagetable(pagetable_t pagetable, uint64 sz)
@@ -245,6 +283,84 @@ void proc_freepagetable(pagetable_t pagetable, uint64 sz)
   uvmfree(pagetable, sz);
 }
 
+// Take a reference to mm, or allocate one if mm is 0.
+static struct mm *
+mmget(struct mm *mm)
+{
+  acquire(&mmtab.lock);
+  if (mm == NULL)
+  {
+    for (mm = mmtab.mm; mm < &mmtab.mm[NPROC] && mm->ref; mm++)
+      ;
+    if (mm == &mmtab.mm[NPROC])
+    {
+      release(&mmtab.lock);
+      return NULL;
+    }
+  }
+  mm->ref++;
+  release(&mmtab.lock);
+  return mm;
+}
+
+// Drop a reference to mm and return how many are left.
+static int
+mmput(struct mm *mm)
+{
+  int ref;
+
+  acquire(&mmtab.lock);
+  if (mm->ref < 1)
+    panic("mmput");
+  ref = --mm->ref;
+  release(&mmtab.lock);
+  return ref;
+}
+
+// Free a page table p is giving up, with the user memory of size sz
+// mapped in it. If other threads still share that memory through
+// p->mm, only p's private part (root, trampoline, trapframe and,
+// with stack_free, the kernel stack) goes. Without stack_free the
+// kernel stack is left to the page table exec() moved it to.
+void proc_freeuvm(struct proc *p, pagetable_t pagetable, uint64 sz, int stack_free)
+{
+  pte_t *pte;
+
+  if (p->mm)
+  {
+    if (mmput(p->mm) > 0)
+    {
+      uvmunshare(pagetable);
+      sz = 0;
+    }
+    p->mm = 0;
+  }
+  if (pagetable == NULL)
+    return;
+  if (!stack_free)
+    pagetable[PX(2, VKSTACK)] = 0;
+  else if ((pte = walk(pagetable, VKSTACK, 0)) != NULL && (*pte & PTE_V))
+    vmunmap(pagetable, VKSTACK, 1, 1);
+  proc_freepagetable(pagetable, sz);
+}
+
+// Record sz as the size of p's memory, and of every thread sharing it.
+// Caller must hold p->mm->lock if p->mm is set.
+static void
+setsz(struct proc *p, uint64 sz)
+{
+  struct proc *q;
+
+  if (p->mm == NULL)
+  {
+    p->sz = sz;
+    return;
+  }
+  for (q = proc; q < &proc[NPROC]; q++)
+    if (q->mm == p->mm)
+      q->sz = sz;
+}
+
 // a user program that calls exec("/init")
 // od -t xC initcode
 uchar initcode[] = {
@@ -292,7 +408,7 @@ void userinit(void)
 
   // allocate one user page and copy init's instructions
   // and data into it.
-  uvminit(p->pagetable, p->kpagetable, initcode, sizeof(initcode));
+  uvminit(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
@@ -316,32 +432,270 @@ void userinit(void)
 int growproc(int n)
 {
   uint sz;
+  int swapped = 0;
   struct proc *p = myproc();
 
+again:
+  if (p->mm)
+    acquire(&p->mm->lock);
   sz = p->sz;
   if (n > 0)
   {
-    if ((sz = uvmalloc(p->pagetable, p->kpagetable, sz, sz + n)) == 0)
+    if ((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0)
     {
+      if (p->mm)
+        release(&p->mm->lock);
+      // out of memory: page some of ours out and try once more.
+      if (!swapped++ && swapout(1, PGROUNDUP(n) / PGSIZE) > 0)
+        goto again;
       return -1;
     }
   }
   else if (n < 0)
   {
-    sz = uvmdealloc(p->pagetable, p->kpagetable, sz, sz + n);
+    sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  setsz(p, sz);
+  if (p->mm)
+    release(&p->mm->lock);
   return 0;
 }
 
+// Unmap npages of the current process's memory at addr, for munmap().
+// The pages are freed only if no CLONE_VM thread shares them: without
+// a TLB shootdown another hart could still reach a page through a
+// stale entry, so shared ones are left allocated.
+void munmapproc(uint64 addr, int npages)
+{
+  struct proc *p = myproc();
+
+  if (p->mm)
+    acquire(&p->mm->lock);
+  // mm->ref only rises above 1 through clone() by a sharer, so an
+  // unlocked read can at worst keep pages that could have gone.
+  vmunmap(p->pagetable, addr, npages, p->mm == NULL || p->mm->ref == 1);
+  if (p->mm)
+    release(&p->mm->lock);
+  sfence_vma();
+}
+
+// Append n bytes of fresh memory at the next page boundary above the
+// current size, for mmap(). Returns the start address, or -1.
+uint64 growmmap(int n)
+{
+  uint64 addr, sz;
+  struct proc *p = myproc();
+
+  if (p->mm)
+    acquire(&p->mm->lock);
+  addr = PGROUNDUP(p->sz);
+  if ((sz = uvmalloc(p->pagetable, p->sz, addr + n)) == 0)
+    addr = -1;
+  else
+    setsz(p, sz);
+  if (p->mm)
+    release(&p->mm->lock);
+  return addr;
+}
+
+// Map len bytes of ep's data from off (page-aligned) read-only at the
+// next page boundary above the current size, for mmap(). The pages are
+// the page cache's, shared with every other reader of the file; past
+// the end of the file they are zero. Returns the start address, or -1.
+uint64 mmapfile(struct dirent *ep, uint off, int len)
+{
+  struct proc *p = myproc();
+  char **pages;
+  int i, j, npage = PGROUNDUP(len) / PGSIZE;
+  uint64 addr = -1;
+
+  if (npage > PGSIZE / sizeof(char *) || (pages = kalloc()) == NULL)
+    return -1;
+  elock(ep);
+  for (i = 0; i < npage; i++)
+  {
+    if ((pages[i] = pcget(ep, off + i * PGSIZE)) != NULL)
+      continue;
+    // past the end, or the cache is out of pages: a private copy
+    if ((pages[i] = kalloc()) == NULL)
+      break;
+    pagezero(pages[i]);
+    eload(ep, 0, (uint64)pages[i], off + i * PGSIZE, PGSIZE);
+  }
+  eunlock(ep);
+
+  if (i == npage)
+  {
+    if (p->mm)
+      acquire(&p->mm->lock);
+    addr = PGROUNDUP(p->sz);
+    for (j = 0; j < npage; j++)
+      if (mappages(p->pagetable, addr + j * PGSIZE, PGSIZE, (uint64)pages[j], PTE_R | PTE_U) < 0)
+        break;
+    if (j == npage)
+      setsz(p, addr + len);
+    else
+    {
+      vmunmap(p->pagetable, addr, j, 0);
+      addr = -1;
+    }
+    if (p->mm)
+      release(&p->mm->lock);
+  }
+  if (addr == -1)
+    while (--i >= 0)
+      kfree(pages[i]);
+  kfree(pages);
+  return addr;
+}
+
+// The segment of p's executable holding user address va, or 0.
+static struct seg *
+segof(struct proc *p, uint64 va)
+{
+  struct seg *s;
+
+  for (s = p->seg; s < &p->seg[p->nseg]; s++)
+    if (va >= s->va && va < s->end)
+      return s;
+  return NULL;
+}
+
+// Read in the page at va of p's segment s. Read-only text with no
+// bss gets the page cache's copy, shared with every other process
+// running the program; anything else a private copy, zero-filled past
+// the part the file backs. A page wholly past it needs no read and
+// doesn't lock the executable. Returns 0 if memory or the read fails.
+static char *
+segpage(struct proc *p, struct seg *s, uint64 va)
+{
+  char *mem = NULL;
+  uint64 n;
+
+  if (va >= s->fend)
+  {
+    if ((mem = kalloc()) != NULL)
+      pagezero(mem);
+    return mem;
+  }
+  elock(p->exe);
+  if (!(s->perm & PTE_W) && s->fend == s->end && s->off % PGSIZE == 0)
+    mem = pcget(p->exe, s->off + (va - s->va));
+  if (mem == NULL && (mem = kalloc()) != NULL)
+  {
+    pagezero(mem);
+    n = va >= s->fend ? 0 : s->fend - va < PGSIZE ? s->fend - va : PGSIZE;
+    if (n > 0 && eread(p->exe, 0, (uint64)mem, s->off + (va - s->va), n) != n)
+    {
+      kfree(mem);
+      mem = NULL;
+    }
+  }
+  eunlock(p->exe);
+  return mem;
+}
+
+// Handle a fault on user address va by an access needing perm
+// (PTE_R, PTE_W or PTE_X), from user or kernel mode. A page exec()
+// left unloaded is read in from the executable (see segpage()), one
+// paged out is read back from swap. Returns 0 if the access can be
+// retried, -1 if it is a genuine fault.
+int pagefault(uint64 va, int perm)
+{
+  struct proc *p = myproc();
+  struct seg *s;
+  pte_t *pte, old;
+  char *mem;
+  int r, flags;
+
+  va = PGROUNDDOWN(va);
+  if (va >= p->sz)
+    return -1;
+  // already there: another thread faulted it in, the hardware wants
+  // PTE_A or PTE_D set by software (swapout() clears PTE_A), or perm
+  // is denied.
+  if ((pte = walk(p->pagetable, va, 0)) != NULL && (*pte & PTE_V))
+  {
+    if ((*pte & (perm | PTE_U)) != (perm | PTE_U))
+      return -1;
+    flags = PTE_A | (perm == PTE_W ? PTE_D : 0);
+    if ((*pte & flags) != flags)
+    {
+      *pte |= flags;
+      sfence_vma();
+    }
+    return 0;
+  }
+  old = pte ? *pte : 0;
+  if (old & PTE_SWAP)
+  {
+    flags = old & (PTE_R | PTE_W | PTE_X | PTE_U);
+    if ((flags & (perm | PTE_U)) != (perm | PTE_U) ||
+        (mem = swapread(old)) == NULL)
+      return -1;
+  }
+  else
+  {
+    if ((s = segof(p, va)) == NULL || (s->perm & perm) != perm ||
+        (mem = segpage(p, s, va)) == NULL)
+      return -1;
+    flags = s->perm | PTE_U;
+  }
+
+  // threads sharing the memory may race us to the same page.
+  if (p->mm)
+    acquire(&p->mm->lock);
+  r = 0;
+  if ((pte = walk(p->pagetable, va, 1)) == NULL)
+    r = -1;
+  else if (*pte == old)
+  {
+    *pte = PA2PTE(mem) | flags | PTE_V;
+    mem = NULL;
+    if (old & PTE_SWAP)
+      swapput(old);
+  }
+  if (p->mm)
+    release(&p->mm->lock);
+  if (mem)
+    kfree(mem);
+  sfence_vma();
+  return r;
+}
+
+// Bring in the pages of [va, va+len) that exec() left unloaded and
+// those paged out to swap, before the caller takes locks that a fault
+// reading them in mid-copy could not sleep under. Bad addresses are
+// left for the copy itself to reject.
+void prefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct seg *s;
+  pte_t *pte;
+  uint64 a, end;
+
+  if (len == 0 || va + len < va)
+    return;
+  end = va + len < p->sz ? va + len : p->sz;
+  for (a = PGROUNDDOWN(va); a < end; a += PGSIZE)
+  {
+    pte = walk(p->pagetable, a, 0);
+    if (pte && (*pte & PTE_V))
+      continue;
+    if ((pte && (*pte & PTE_SWAP)) || (s = segof(p, a)) != NULL)
+      pagefault(a, PTE_R);
+  }
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int fork(void)
 {
-  int i, pid;
+  int i, pid, swapped = 0;
   struct proc *np;
   struct proc *p = myproc();
 
+again:
   // Allocate process.
   if ((np = allocproc()) == NULL)
   {
@@ -349,10 +703,14 @@ int fork(void)
   }
 
   // Copy user memory from parent to child.
-  if (uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0)
+  if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0)
   {
     freeproc(np);
     release(&np->lock);
+    // out of memory: page some of ours out, the child sharing
+    // their swap slots, and try once more.
+    if (!swapped++ && swapout(1, p->sz / PGSIZE) > 0)
+      goto again;
     return -1;
   }
   np->sz = p->sz;
@@ -373,6 +731,9 @@ int fork(void)
     if (p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = edup(p->cwd);
+  np->exe = edup(p->exe);
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -422,19 +783,19 @@ void exit(int status)
   if (p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for (int fd = 0; fd < NOFILE; fd++)
-  {
-    if (p->ofile[fd])
-    {
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
+  // Close all open files, unless threads still share them, and any
+  // a system call that ends here was holding.
+  fdrelease();
+  fdtput(p->fdt);
+  p->fdt = 0;
+  p->ofile = 0;
 
   eput(p->cwd);
   p->cwd = 0;
+  if (p->exe)
+    eput(p->exe);
+  p->exe = 0;
+  p->nseg = 0;
 
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
@@ -514,15 +875,13 @@ int wait(int upid, uint64 addr, int options)
 
           // printf("status: %d\n", np->xstate);
           // printf("pid: %d\n", pid);
-          if (addr != 0 && copyout2(addr, (char *)&status, sizeof(status)) < 0)
-          {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
           freeproc(np);
           release(&np->lock);
           release(&p->lock);
+          // only now: the copy may fault the page in from disk, which
+          // sleeps and so can't happen under the locks.
+          if (addr != 0 && copyout2(addr, (char *)&status, sizeof(status)) < 0)
+            return -1;
           // printf("pid %d ended\n", pid);
           return pid;
         }
@@ -553,7 +912,6 @@ void scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  extern pagetable_t kernel_pagetable;
 
   c->proc = 0;
   for (;;)
@@ -573,11 +931,14 @@ void scheduler(void)
         // printf("[scheduler]found runnable proc with pid: %d\n", p->pid);
         p->state = RUNNING;
         c->proc = p;
-        w_satp(MAKE_SATP(p->kpagetable));
-        sfence_vma();
+        kvmswitch(p->pagetable);
         swtch(&c->context, &p->context);
-        w_satp(MAKE_SATP(kernel_pagetable));
-        sfence_vma();
+        // Stay on p's page table rather than going back to
+        // kernel_pagetable: it maps the kernel the same way, and the
+        // next process pays for a single satp write and flush (none
+        // if it is p again). Re-register it, as exec() may have
+        // swapped it while p ran.
+        kvmswitch(p->pagetable);
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
@@ -649,6 +1010,7 @@ void forkret(void)
     first = 0;
     fat32_init();
     myproc()->cwd = ename("/");
+    swapinit();
   }
 
   usertrapret();
@@ -826,23 +1188,65 @@ procnum(void)
   return num;
 }
 
+// Make np share p's user memory, starting a CLONE_VM group if p is
+// not in one yet. Returns 0 on success, -1 on failure.
+static int
+threadshare(struct proc *p, struct proc *np)
+{
+  struct mm *mm;
+
+  // a p without p->mm has no threads, so nothing else can be
+  // growing it while uvmshare() fills in its level-1 tables.
+  if ((mm = p->mm) == NULL && (mm = mmget(NULL)) == NULL)
+    return -1;
+  acquire(&mm->lock);
+  if (uvmshare(p->pagetable, np->pagetable) < 0)
+  {
+    release(&mm->lock);
+    uvmunshare(np->pagetable);
+    if (p->mm == NULL)
+      mmput(mm);
+    return -1;
+  }
+  p->mm = mm;
+  np->mm = mmget(mm);
+  release(&mm->lock);
+  return 0;
+}
+
+// Create a new process like fork(), or a thread: with CLONE_VM the
+// child shares the parent's user memory instead of copying it, and
+// with CLONE_FILES its descriptor table.
 int clone(void)
 {
-  int i, pid;
+  int i, pid, swapped = 0;
   struct proc *np;
   struct proc *p = myproc();
+  int flags = p->trapframe->a0;
 
+again:
   // Allocate process.
   if ((np = allocproc()) == NULL)
   {
     return -1;
   }
 
+  if (flags & CLONE_VM)
+  {
+    if (threadshare(p, np) < 0)
+    {
+      freeproc(np);
+      release(&np->lock);
+      return -1;
+    }
+  }
   // Copy user memory from parent to child.
-  if (uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0)
+  else if (uvmcopy(p->pagetable, np->pagetable, p->sz) < 0)
   {
     freeproc(np);
     release(&np->lock);
+    if (!swapped++ && swapout(1, p->sz / PGSIZE) > 0)
+      goto again;
     return -1;
   }
   np->sz = p->sz;
@@ -871,11 +1275,24 @@ int clone(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  // increment reference counts on open file descriptors.
-  for (i = 0; i < NOFILE; i++)
-    if (p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
+  if (flags & CLONE_FILES)
+  {
+    // np's own table is still empty.
+    fdtput(np->fdt);
+    np->fdt = fdtdup(p->fdt);
+    np->ofile = np->fdt->ofile;
+  }
+  else
+  {
+    // increment reference counts on open file descriptors.
+    for (i = 0; i < NOFILE; i++)
+      if (p->ofile[i])
+        np->ofile[i] = filedup(p->ofile[i]);
+  }
   np->cwd = edup(p->cwd);
+  np->exe = edup(p->exe);
+  memmove(np->seg, p->seg, sizeof(p->seg));
+  np->nseg = p->nseg;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
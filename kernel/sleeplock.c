@@ -8,6 +8,7 @@
 #include "include/spinlock.h"
 #include "include/proc.h"
 #include "include/sleeplock.h"
+#include "include/lockstat.h"
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -16,17 +17,37 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->stat = lockstat_find(name, LOCKSTAT_SLEEP);
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+#ifdef LOCKSTAT
+  uint64 t = 0;
+  int waited;
+#endif
+
   acquire(&lk->lk);
+#ifdef LOCKSTAT
+  if ((waited = lk->locked) != 0)
+    t = r_time();
+#endif
   while (lk->locked) {
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+#ifdef LOCKSTAT
+  if (lk->stat) {
+    __sync_fetch_and_add(&lk->stat->acquires, 1);
+    if (waited) {
+      __sync_fetch_and_add(&lk->stat->contended, 1);
+      __sync_fetch_and_add(&lk->stat->waitticks, r_time() - t);
+    }
+    lk->t0 = r_time();
+  }
+#endif
   release(&lk->lk);
 }
 
@@ -34,6 +55,10 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+#ifdef LOCKSTAT
+  if (lk->stat)
+    __sync_fetch_and_add(&lk->stat->holdticks, r_time() - lk->t0);
+#endif
   lk->locked = 0;
   lk->pid = 0;
   wakeup(lk);
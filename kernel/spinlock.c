@@ -9,6 +9,123 @@
 #include "include/proc.h"
 #include "include/intr.h"
 #include "include/printf.h"
+#include "include/string.h"
+#include "include/vm.h"
+#include "include/lockstat.h"
+
+#ifdef LOCKSTAT
+#define NLOCKSTAT 48  // distinct lock names tracked; the last is "(other)"
+
+// Contention statistics, pooled by lock name: all the "proc" locks,
+// say, share one entry. Different CPUs may update one entry through
+// different locks at once, hence the atomic adds.
+static struct lockstat lockstats[NLOCKSTAT];
+static struct spinlock statlock = { .name = "lockstat" };  // not itself counted
+
+#define NSTATCACHE 128  // name pointers lockstat_find() remembers; a power of 2
+
+// Lock names are string literals, so one name pointer
+// stands for one call site. lockstat_find() remembers the entry each
+// pointer maps to, and compares strings only the first time a pointer
+// shows up, keeping initlock() cheap for locks made all the time
+// (pipes, directory entries). Slots are filled once, under statlock,
+// with name stored last; lookups read them without the lock.
+static struct {
+  char *name;
+  int type;
+  struct lockstat *stat;
+} statcache[NSTATCACHE];
+
+// Look name up in statcache, returning its slot, or the empty slot
+// where it belongs, or -1 if the cache is full.
+static int
+statcache_slot(char *name, int type)
+{
+  int h = (((uint64)name >> 3) ^ type) & (NSTATCACHE - 1);
+
+  for(int i = 0; i < NSTATCACHE; i++, h = (h + 1) & (NSTATCACHE - 1)){
+    if(statcache[h].name == 0 ||
+       (statcache[h].name == name && statcache[h].type == type))
+      return h;
+  }
+  return -1;
+}
+
+// Return the statistics entry for locks of this name and type,
+// creating it on first use.
+struct lockstat *
+lockstat_find(char *name, int type)
+{
+  struct lockstat *s;
+  int h;
+
+  if((h = statcache_slot(name, type)) >= 0 && statcache[h].name){
+    __sync_synchronize();  // pairs with the store of name below
+    return statcache[h].stat;
+  }
+
+  acquire(&statlock);
+  if((h = statcache_slot(name, type)) >= 0 && statcache[h].name){
+    s = statcache[h].stat;
+    release(&statlock);
+    return s;
+  }
+  for(s = lockstats; s < &lockstats[NLOCKSTAT - 1] && s->name[0]; s++){
+    if(s->type == type && strncmp(s->name, name, sizeof(s->name) - 1) == 0)
+      break;
+  }
+  if(s->name[0] == 0){
+    safestrcpy(s->name, s < &lockstats[NLOCKSTAT - 1] ? name : "(other)", sizeof(s->name));
+    s->type = type;
+  }
+  if(h >= 0){
+    statcache[h].type = type;
+    statcache[h].stat = s;
+    __sync_synchronize();
+    statcache[h].name = name;
+  }
+  release(&statlock);
+  return s;
+}
+
+// Copy up to n entries in use to user address addr, then clear all
+// counters if reset is set. Returns the number copied, or -1.
+int
+lockstat_copy(uint64 addr, int n, int reset)
+{
+  struct lockstat st;
+  int got = 0;
+
+  for(struct lockstat *s = lockstats; s < &lockstats[NLOCKSTAT] && got < n; s++){
+    if(s->name[0] == 0 || s->acquires == 0)
+      continue;
+    st = *s;
+    if(copyout2(addr + got * sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+    got++;
+  }
+  if(reset){
+    for(struct lockstat *s = lockstats; s < &lockstats[NLOCKSTAT]; s++){
+      s->acquires = s->contended = s->spins = 0;
+      s->waitticks = s->holdticks = 0;
+    }
+  }
+  return got;
+}
+#else
+// Built without lockstat=1: no statistics are kept.
+struct lockstat *
+lockstat_find(char *name, int type)
+{
+  return 0;
+}
+
+int
+lockstat_copy(uint64 addr, int n, int reset)
+{
+  return -1;
+}
+#endif
 
 void
 initlock(struct spinlock *lk, char *name)
@@ -16,6 +133,7 @@ initlock(struct spinlock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->stat = lockstat_find(name, LOCKSTAT_SPIN);
 }
 
 // Acquire the lock.
@@ -31,8 +149,21 @@ acquire(struct spinlock *lk)
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
+#ifdef LOCKSTAT
+  // The first try is outside the loop so the uncontended path
+  // doesn't read the clock.
+  uint64 spins = 0, t = 0;
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    t = r_time();
+    do
+      spins++;
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0);
+    t = r_time() - t;
+  }
+#else
   while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
     ;
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -42,6 +173,18 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+#ifdef LOCKSTAT
+  if(lk->stat){
+    __sync_fetch_and_add(&lk->stat->acquires, 1);
+    if(spins){
+      __sync_fetch_and_add(&lk->stat->contended, 1);
+      __sync_fetch_and_add(&lk->stat->spins, spins);
+      __sync_fetch_and_add(&lk->stat->waitticks, t);
+    }
+    lk->t0 = r_time();
+  }
+#endif
 }
 
 // Release the lock.
@@ -51,6 +194,10 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  if(lk->stat)
+    __sync_fetch_and_add(&lk->stat->holdticks, r_time() - lk->t0);
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
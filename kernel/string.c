@@ -1,14 +1,41 @@
 #include "include/types.h"
+#include "include/riscv.h"
+
+// The mem* routines move a 64-bit word at a time, four words per
+// loop iteration, once dst (and src) are 8-byte aligned. Unaligned
+// heads and tails, and buffers whose alignments differ (misaligned
+// word accesses trap on RISC-V), go a byte at a time.
+
+#define WSIZE sizeof(uint64)
+#define WMASK (WSIZE - 1)
 
 void *
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *)dst;
-  int i;
-  for (i = 0; i < n; i++)
+  uchar *d = (uchar *)dst;
+  uint64 *wd, w;
+
+  if (n >= 2 * WSIZE)
   {
-    cdst[i] = c;
+    for (; (uint64)d & WMASK; n--)
+      *d++ = c;
+    w = (uchar)c;
+    w |= w << 8;
+    w |= w << 16;
+    w |= w << 32;
+    for (wd = (uint64 *)d; n >= 4 * WSIZE; n -= 4 * WSIZE, wd += 4)
+    {
+      wd[0] = w;
+      wd[1] = w;
+      wd[2] = w;
+      wd[3] = w;
+    }
+    for (; n >= WSIZE; n -= WSIZE)
+      *wd++ = w;
+    d = (uchar *)wd;
   }
+  while (n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -18,6 +45,15 @@ int memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  if (n >= 2 * WSIZE && (((uint64)s1 ^ (uint64)s2) & WMASK) == 0)
+  {
+    for (; (uint64)s1 & WMASK; n--, s1++, s2++)
+      if (*s1 != *s2)
+        return *s1 - *s2;
+    // skip equal words; the byte loop finds the difference in the first unequal one.
+    for (; n >= WSIZE && *(uint64 *)s1 == *(uint64 *)s2; n -= WSIZE)
+      s1 += WSIZE, s2 += WSIZE;
+  }
   while (n-- > 0)
   {
     if (*s1 != *s2)
@@ -31,21 +67,65 @@ int memcmp(const void *v1, const void *v2, uint n)
 void *
 memmove(void *dst, const void *src, uint n)
 {
-  const char *s;
-  char *d;
+  const uchar *s;
+  uchar *d;
+  const uint64 *ws;
+  uint64 *wd;
+  int words;
 
   s = src;
   d = dst;
+  words = n >= 2 * WSIZE && (((uint64)s ^ (uint64)d) & WMASK) == 0;
   if (s < d && s + n > d)
   {
     s += n;
     d += n;
+    if (words)
+    {
+      for (; (uint64)d & WMASK; n--)
+        *--d = *--s;
+      ws = (const uint64 *)s;
+      wd = (uint64 *)d;
+      for (; n >= 4 * WSIZE; n -= 4 * WSIZE)
+      {
+        ws -= 4;
+        wd -= 4;
+        wd[3] = ws[3];
+        wd[2] = ws[2];
+        wd[1] = ws[1];
+        wd[0] = ws[0];
+      }
+      for (; n >= WSIZE; n -= WSIZE)
+        *--wd = *--ws;
+      s = (const uchar *)ws;
+      d = (uchar *)wd;
+    }
     while (n-- > 0)
       *--d = *--s;
   }
   else
+  {
+    if (words)
+    {
+      for (; (uint64)d & WMASK; n--)
+        *d++ = *s++;
+      ws = (const uint64 *)s;
+      wd = (uint64 *)d;
+      for (; n >= 4 * WSIZE; n -= 4 * WSIZE, ws += 4, wd += 4)
+      {
+        wd[0] = ws[0];
+        wd[1] = ws[1];
+        wd[2] = ws[2];
+        wd[3] = ws[3];
+      }
+      for (; n >= WSIZE; n -= WSIZE)
+        *wd++ = *ws++;
+      s = (const uchar *)ws;
+      d = (uchar *)wd;
+    }
     while (n-- > 0)
       *d++ = *s++;
+  }
 
   return dst;
 }
@@ -57,6 +137,48 @@ memcpy(void *dst, const void *src, uint n)
   return memmove(dst, src, n);
 }
 
+// Copy a whole page between two page-aligned, non-overlapping
+// buffers, eight words per iteration.
+void
+pagecopy(void *dst, const void *src)
+{
+  uint64 *d = (uint64 *)dst;
+  const uint64 *s = (const uint64 *)src;
+  uint64 *end = d + PGSIZE / WSIZE;
+
+  for (; d < end; d += 8, s += 8)
+  {
+    d[0] = s[0];
+    d[1] = s[1];
+    d[2] = s[2];
+    d[3] = s[3];
+    d[4] = s[4];
+    d[5] = s[5];
+    d[6] = s[6];
+    d[7] = s[7];
+  }
+}
+
+// Zero a whole page-aligned page, eight words per iteration.
+void
+pagezero(void *dst)
+{
+  uint64 *d = (uint64 *)dst;
+  uint64 *end = d + PGSIZE / WSIZE;
+
+  for (; d < end; d += 8)
+  {
+    d[0] = 0;
+    d[1] = 0;
+    d[2] = 0;
+    d[3] = 0;
+    d[4] = 0;
+    d[5] = 0;
+    d[6] = 0;
+    d[7] = 0;
+  }
+}
+
 int strncmp(const char *p, const char *q, uint n)
 {
   while (n > 0 && *p && *p == *q)
@@ -161,3 +283,95 @@ char *str_mycat(char *dest, const char *src, int max_len)
   dest[max_len - 1] = '\0'; // 确保字符串以空字符结尾
   return dest;
 }
+
+#ifdef SELFTEST
+#include "include/kalloc.h"
+#include "include/printf.h"
+
+// Byte-at-a-time reference for the word-wide routines.
+static void
+bytemove(uchar *d, const uchar *s, uint n)
+{
+  if (s < d && s + n > d)
+    while (n-- > 0)
+      d[n] = s[n];
+  else
+    for (uint i = 0; i < n; i++)
+      d[i] = s[i];
+}
+
+// Check memmove/memset/memcmp against the byte loops over every
+// head alignment and a spread of lengths, then time them on page-sized
+// buffers. Built with make selftest=1; runs once at boot.
+void
+stringtest(void)
+{
+  static uint lens[] = {0, 1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 100, 1000};
+  uchar *a, *b, *ref;
+  uint64 t0, t1;
+  int i, round;
+
+  if ((a = kalloc()) == NULL || (b = kalloc()) == NULL || (ref = kalloc()) == NULL)
+    panic("stringtest: kalloc");
+  for (int l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+  {
+    uint n = lens[l];
+    for (int da = 0; da < 8; da++)
+    {
+      for (int sa = -8; sa < 16; sa++)
+      {
+        for (i = 0; i < PGSIZE; i++)
+          a[i] = ref[i] = i * 7 + 3;
+        memmove(a + 64 + da, a + 64 + da + sa, n);
+        bytemove(ref + 64 + da, ref + 64 + da + sa, n);
+        if (memcmp(a, ref, PGSIZE) != 0)
+          panic("stringtest: memmove");
+      }
+      memset(a + da, 0xa5, n);
+      for (i = 0; i < n; i++)
+        if (a[da + i] != 0xa5)
+          panic("stringtest: memset");
+      memmove(b + 8 - da, a + da, n);
+      if (n > 0)
+      {
+        b[8 - da + n - 1] ^= 1;
+        if (memcmp(a + da, b + 8 - da, n) == 0)
+          panic("stringtest: memcmp");
+        b[8 - da + n - 1] ^= 1;
+      }
+      if (memcmp(a + da, b + 8 - da, n) != 0)
+        panic("stringtest: memcmp equal");
+    }
+  }
+
+  t0 = r_time();
+  for (round = 0; round < 256; round++)
+    bytemove(b, a, PGSIZE);
+  t1 = r_time();
+  printf("stringtest: page copy, bytes %d ticks,", (int)(t1 - t0));
+  t0 = r_time();
+  for (round = 0; round < 256; round++)
+    memmove(b, a, PGSIZE);
+  t1 = r_time();
+  printf(" memmove %d,", (int)(t1 - t0));
+  t0 = r_time();
+  for (round = 0; round < 256; round++)
+    pagecopy(b, a);
+  t1 = r_time();
+  printf(" pagecopy %d\n", (int)(t1 - t0));
+  t0 = r_time();
+  for (round = 0; round < 256; round++)
+    memset(b, 0, PGSIZE);
+  t1 = r_time();
+  printf("stringtest: page zero, memset %d ticks,", (int)(t1 - t0));
+  t0 = r_time();
+  for (round = 0; round < 256; round++)
+    pagezero(b);
+  t1 = r_time();
+  printf(" pagezero %d\n", (int)(t1 - t0));
+
+  kfree(a);
+  kfree(b);
+  kfree(ref);
+}
+#endif
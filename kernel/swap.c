@@ -0,0 +1,240 @@
+// Swap.
+//
+// When memory runs out, cold user pages are written to /swapfile, a
+// file of NSWAP pages set up at boot, and their PTEs are replaced by
+// swap entries naming the slot (see swap.h). The next touch faults the
+// page back in through pagefault().
+//
+// Victims are picked by a clock sweeping the processes' page tables:
+// a page the hardware marked accessed since the hand last passed only
+// has its PTE_A cleared. The hand only visits processes that can't be
+// touching their memory: those parked at the user boundary by a timer
+// preemption, whose kernel side won't run again before they are back
+// in user space, and the caller itself when it asks from a point
+// where it holds on to none of its pages (growproc(), fork(), a user
+// page fault). Read-only and shared pages stay, as the page cache
+// reclaims file pages itself, and so do CLONE_VM threads' pages.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/sleeplock.h"
+#include "include/proc.h"
+#include "include/fat32.h"
+#include "include/kalloc.h"
+#include "include/vm.h"
+#include "include/swap.h"
+#include "include/string.h"
+#include "include/intr.h"
+#include "include/printf.h"
+
+#define SWAPBATCH 8  // pages unmapped per trip to the disk
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;   // guards ref[] and slot
+  struct dirent *ep;      // the swap file, 0 while swap is off
+  uchar ref[NSWAP];       // swap PTEs naming each slot
+  int slot;               // where the search for a free slot resumes
+  // clock hand, moved only with ep->lock held:
+  int hand;               // index into proc[]
+  uint64 va;              // next page of proc[hand] to look at
+} swap;
+
+static int swapreclaim(void);
+
+// Set up /swapfile, growing it to NSWAP pages if it is shorter, and
+// start paging out when kalloc() runs dry. Must run in a process,
+// after fat32_init().
+void
+swapinit(void)
+{
+  struct dirent *dp, *ep;
+  char *zero;
+  uint off;
+
+  initlock(&swap.lock, "swap");
+  if((dp = ename("/")) == NULL)
+    return;
+  elock(dp);
+  ep = ealloc(dp, "swapfile", 0);
+  eunlock(dp);
+  eput(dp);
+  if(ep == NULL || (ep->attribute & ATTR_DIRECTORY) || (zero = kalloc()) == NULL){
+    printf("swapinit: no swap file\n");
+    if(ep)
+      eput(ep);
+    return;
+  }
+  pagezero(zero);
+  elock(ep);
+  for(off = PGROUNDDOWN(ep->file_size); off < NSWAP * PGSIZE; off += PGSIZE)
+    if(ewrite(ep, 0, (uint64)zero, off, PGSIZE) != PGSIZE)
+      break;
+  eunlock(ep);
+  kfree(zero);
+  if(off < NSWAP * PGSIZE){
+    printf("swapinit: swap file short\n");
+    eput(ep);
+    return;
+  }
+  swap.ep = ep;
+  kshrinker(swapreclaim);
+}
+
+// Take a free slot, or return -1 if swap is full.
+static int
+slotalloc(void)
+{
+  int s;
+
+  acquire(&swap.lock);
+  for(int i = 0; i < NSWAP; i++){
+    s = (swap.slot + i) % NSWAP;
+    if(swap.ref[s] == 0){
+      swap.ref[s] = 1;
+      swap.slot = (s + 1) % NSWAP;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// May the hand take pages from p? Caller must hold p->lock.
+static int
+swappable(struct proc *p, int self)
+{
+  if(p->mm || p->pagetable == NULL)
+    return 0;
+  if(p == myproc())
+    return self;
+  return p->state == RUNNABLE && p->atuser;
+}
+
+// Unmap up to n of p's pages into swap slots, from the hand on, and
+// record them in pa[] and slot[]. Returns how many were taken; fewer
+// than n once the hand has swept the rest of p, or swap is full.
+// Caller must hold p->lock.
+static int
+pickpages(struct proc *p, char **pa, int *slot, int n)
+{
+  pte_t *pte;
+  int k = 0, s;
+
+  for(; k < n && swap.va < p->sz; swap.va += PGSIZE){
+    pte = walk(p->pagetable, swap.va, 0);
+    if(pte == NULL || (*pte & (PTE_V|PTE_U|PTE_W)) != (PTE_V|PTE_U|PTE_W))
+      continue;
+    if(*pte & PTE_A){  // second chance
+      *pte &= ~PTE_A;
+      continue;
+    }
+    if(kcount((void*)PTE2PA(*pte)) > 1)
+      continue;
+    if((s = slotalloc()) < 0)
+      break;
+    pa[k] = (char*)PTE2PA(*pte);
+    slot[k++] = s;
+    *pte = SWAPPTE(s, PTE_FLAGS(*pte));
+  }
+  return k;
+}
+
+// Page out up to want user pages, the caller's own too if self is
+// set. Returns how many pages of memory were freed.
+int
+swapout(int self, int want)
+{
+  struct proc *p;
+  char *pa[SWAPBATCH];
+  int slot[SWAPBATCH];
+  int i, k, n = 0, visits = 0;
+
+  // swap off, or this process is paging out already.
+  if(swap.ep == NULL || holdingsleep(&swap.ep->lock))
+    return 0;
+  elock(swap.ep);
+  while(n < want && visits <= 2 * NPROC){
+    p = &proc[swap.hand];
+    i = want - n < SWAPBATCH ? want - n : SWAPBATCH;
+    acquire(&p->lock);
+    k = swappable(p, self) ? pickpages(p, pa, slot, i) : 0;
+    if(k < i){  // done with p for this round
+      swap.hand = (swap.hand + 1) % NPROC;
+      swap.va = 0;
+      visits++;
+    }
+    release(&p->lock);
+    // the swap PTEs are in place, so any fault on these pages now
+    // waits for the swap file's lock, until they are on disk.
+    for(i = 0; i < k; i++){
+      if(ewrite(swap.ep, 0, (uint64)pa[i], slot[i] * PGSIZE, PGSIZE) != PGSIZE)
+        panic("swapout");
+      kfree(pa[i]);
+    }
+    n += k;
+  }
+  eunlock(swap.ep);
+  if(n > 0 && self)
+    sfence_vma();
+  return n;
+}
+
+// kalloc() shrinker: page out other processes' memory, if the
+// caller is a process holding no spinlock, which may sleep on disk.
+static int
+swapreclaim(void)
+{
+  struct cpu *c;
+  int cansleep;
+
+  push_off();
+  c = mycpu();
+  cansleep = c->proc != NULL && c->noff == 1 && c->intena;
+  pop_off();
+  return cansleep ? swapout(0, SWAPBATCH) : 0;
+}
+
+// Read the page swap PTE pte names into a new page, or return 0.
+char *
+swapread(pte_t pte)
+{
+  char *mem;
+  int n;
+
+  if((mem = kalloc()) == NULL)
+    return NULL;
+  elock(swap.ep);
+  n = eload(swap.ep, 0, (uint64)mem, PTE2SLOT(pte) * PGSIZE, PGSIZE);
+  eunlock(swap.ep);
+  if(n != PGSIZE){
+    kfree(mem);
+    return NULL;
+  }
+  return mem;
+}
+
+// Another PTE names the slot of pte, for fork().
+void
+swapdup(pte_t pte)
+{
+  acquire(&swap.lock);
+  if(++swap.ref[PTE2SLOT(pte)] == 0)
+    panic("swapdup");
+  release(&swap.lock);
+}
+
+// A PTE naming the slot of pte is gone; the slot is free with the last.
+void
+swapput(pte_t pte)
+{
+  acquire(&swap.lock);
+  if(swap.ref[PTE2SLOT(pte)] == 0)
+    panic("swapput");
+  swap.ref[PTE2SLOT(pte)]--;
+  release(&swap.lock);
+}
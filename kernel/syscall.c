@@ -6,11 +6,14 @@
 #include "include/proc.h"
 #include "include/syscall.h"
 #include "include/sysinfo.h"
+#include "include/sysstat.h"
+#include "include/intr.h"
 #include "include/kalloc.h"
 #include "include/vm.h"
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/sbi.h"
+#include "include/file.h"
 
 // Fetch the uint64 at addr from the current process.
 int fetchaddr(uint64 addr, uint64 *ip)
@@ -128,6 +131,23 @@ extern uint64 sys_mount(void);
 extern uint64 sys_umount(void);
 extern uint64 sys_mmap(void);
 extern uint64 sys_munmap(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_tee(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_preadv(void);
+extern uint64 sys_pwritev(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_ioring_enter(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_syscallstat(void);
+extern uint64 sys_kprof(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_readdirplus(void);
 
 extern uint64 sys_shutdown(void);
 
@@ -174,6 +194,23 @@ static uint64 (*syscalls[])(void) = {
     [SYS_umount] sys_umount,
     [SYS_mmap] sys_mmap,
     [SYS_munmap] sys_munmap,
+    [SYS_fcntl] sys_fcntl,
+    [SYS_splice] sys_splice,
+    [SYS_tee] sys_tee,
+    [SYS_sendfile] sys_sendfile,
+    [SYS_readv] sys_readv,
+    [SYS_writev] sys_writev,
+    [SYS_pread] sys_pread,
+    [SYS_pwrite] sys_pwrite,
+    [SYS_preadv] sys_preadv,
+    [SYS_pwritev] sys_pwritev,
+    [SYS_fsync] sys_fsync,
+    [SYS_ioring_enter] sys_ioring_enter,
+    [SYS_futex] sys_futex,
+    [SYS_syscallstat] sys_syscallstat,
+    [SYS_kprof] sys_kprof,
+    [SYS_lockstat] sys_lockstat,
+    [SYS_readdirplus] sys_readdirplus,
     [SYS_shutdown] sys_shutdown,
 };
 
@@ -220,18 +257,83 @@ static char *sysnames[] = {
     [SYS_umount] "umount",
     [SYS_mmap] "mmap",
     [SYS_munmap] "munmap",
+    [SYS_fcntl] "fcntl",
+    [SYS_splice] "splice",
+    [SYS_tee] "tee",
+    [SYS_sendfile] "sendfile",
+    [SYS_readv] "readv",
+    [SYS_writev] "writev",
+    [SYS_pread] "pread",
+    [SYS_pwrite] "pwrite",
+    [SYS_preadv] "preadv",
+    [SYS_pwritev] "pwritev",
+    [SYS_fsync] "fsync",
+    [SYS_ioring_enter] "ioring_enter",
+    [SYS_futex] "futex",
+    [SYS_syscallstat] "syscallstat",
+    [SYS_kprof] "kprof",
+    [SYS_lockstat] "lockstat",
+    [SYS_readdirplus] "readdirplus",
     [SYS_shutdown] "shutdown",
 };
 
+#define NSYSSLOT 80  // more than the number of system calls
+
+// Per-syscall counters and latency histograms. System call numbers
+// are sparse, so syscallinit() gives each a dense slot. Every CPU
+// has its own copy of the counters, so recording one takes no lock.
+// sys_syscallstat() adds the copies up.
+static ushort sysslot[NELEM(syscalls)];
+static int slotnum[NSYSSLOT];
+static int nsysslot;
+static struct sysstat sysstats[NCPU][NSYSSLOT];
+
+void syscallinit(void)
+{
+  for (int num = 0; num < NELEM(syscalls); num++)
+  {
+    if (syscalls[num] == NULL)
+      continue;
+    if (nsysslot == NSYSSLOT)
+      panic("syscallinit: NSYSSLOT");
+    sysslot[num] = nsysslot;
+    slotnum[nsysslot++] = num;
+  }
+}
+
+// Account one call of syscall num that took t ticks.
+static void
+sysstat_record(int num, uint64 t)
+{
+  struct sysstat *st;
+  int b = 0;
+
+  while (t >> b && b < SYSSTAT_NBUCKET - 1)
+    b++;
+  push_off();
+  st = &sysstats[cpuid()][sysslot[num]];
+  st->count++;
+  st->ticks += t;
+  if (t > st->max)
+    st->max = t;
+  st->hist[b]++;
+  pop_off();
+}
+
 void syscall(void)
 {
   int num;
+  uint64 t0;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if (num > 0 && num < NELEM(syscalls) && syscalls[num])
   {
+    t0 = r_time();
     p->trapframe->a0 = syscalls[num]();
+    if (p->nfhold)
+      fdrelease();
+    sysstat_record(num, r_time() - t0);
     // trace
     if ((p->tmask & (1 << num)) != 0)
     {
@@ -296,6 +398,44 @@ uint64 sys_uname(void)
   return 0;
 }
 
+// syscallstat(struct sysstat *st, int n, int reset): copy out the
+// statistics of up to n system calls that have been called, then
+// clear all of them if reset is set. Returns how many were copied.
+uint64
+sys_syscallstat(void)
+{
+  uint64 addr;
+  int n, reset, i, c, b, got = 0;
+  struct sysstat st, *s;
+
+  if (argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &reset) < 0)
+    return -1;
+  for (i = 0; i < nsysslot && got < n; i++)
+  {
+    memset(&st, 0, sizeof(st));
+    for (c = 0; c < NCPU; c++)
+    {
+      s = &sysstats[c][i];
+      st.count += s->count;
+      st.ticks += s->ticks;
+      if (s->max > st.max)
+        st.max = s->max;
+      for (b = 0; b < SYSSTAT_NBUCKET; b++)
+        st.hist[b] += s->hist[b];
+    }
+    if (st.count == 0)
+      continue;
+    st.num = slotnum[i];
+    safestrcpy(st.name, sysnames[st.num], sizeof(st.name));
+    if (copyout2(addr + got * sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+    got++;
+  }
+  if (reset)
+    memset(sysstats, 0, sizeof(sysstats));
+  return got;
+}
+
 uint64 sys_shutdown()
 {
   sbi_shutdown();
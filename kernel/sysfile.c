@@ -19,95 +19,11 @@
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/vm.h"
-
-/**
- * 获取当前目录的绝对路径。
- *
- * @param cwd (struct dirent*): 当前目录项指针。
- * @param path (char*): 用于存储绝对路径的缓冲区。
- * @return int: 成功返回0，失败返回-1。
- */
-int get_abspath(struct dirent *cwd, char *path)
-{
-  if (path == NULL)
-    return -1;
-  strncpy(path, cwd->filename, FAT32_MAX_FILENAME + 1);
-  char temp[FAT32_MAX_FILENAME];
-  while (cwd->parent != NULL)
-  {
-    cwd = cwd->parent;
-    strncpy(temp, cwd->filename, FAT32_MAX_FILENAME);
-    if (temp == NULL)
-      return -1;
-    str_mycat(temp, "/", FAT32_MAX_FILENAME);
-    str_mycat(temp, path, FAT32_MAX_FILENAME);
-    strncpy(path, temp, FAT32_MAX_FILENAME);
-    if (path == NULL)
-      return -1;
-  }
-  return 0;
-}
-
-/**
- * 根据文件描述符和路径名获取绝对路径。
- *
- * @param path (char*): 路径缓冲区。
- * @param fd (int): 文件描述符。
- * @return int: 成功返回0，失败返回-1。
- */
-int get_path(char *path, int fd)
-{
-  if (path == NULL)
-  {
-    printf("path == null\n");
-    return -1;
-  }
-
-  if (path[0] == '/')
-  {
-    return 0;
-  }
-  else if (fd == AT_FDCWD)
-  {
-    struct proc *current_proc = myproc();
-    struct dirent *cwd = current_proc->cwd;
-    char parent_name[FAT32_MAX_FILENAME + 1];
-    if (get_abspath(cwd, parent_name) < 0)
-    {
-      printf("wrong path\n");
-      return -1;
-    }
-    str_mycat(parent_name, "/", FAT32_MAX_FILENAME);
-    str_mycat(parent_name, path, FAT32_MAX_FILENAME);
-    strncpy(path, parent_name, FAT32_MAX_FILENAME);
-    return 0;
-  }
-  else
-  {
-    if (fd < 0)
-      return -1;
-
-    struct proc *current_proc = myproc();
-    struct file *f = current_proc->ofile[fd];
-    if (f == 0)
-      return -1;
-
-    struct dirent *cwd = f->ep;
-    char dirname[FAT32_MAX_FILENAME + 1];
-    if (get_abspath(cwd, dirname) < 0)
-    {
-      printf("wrong path\n");
-      return -1;
-    }
-    str_mycat(dirname, "/", FAT32_MAX_FILENAME);
-    str_mycat(dirname, path, FAT32_MAX_FILENAME);
-    strncpy(path, dirname, FAT32_MAX_FILENAME);
-    return 0;
-  }
-}
+#include "include/ioring.h"
 
 /**
  * 获取第 n 个系统调用参数作为文件描述符，并返回对应的 struct file 指针。
+ * 文件在本次系统调用期间有效，即使共享描述符表的线程同时关闭了它（见 fdget）。
  *
  * @param n (int): 参数索引。
  * @param pfd (int*): 用于返回文件描述符的指针。
@@ -122,7 +38,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if (argint(n, &fd) < 0)
     return -1;
-  if (fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == NULL)
+  if ((f = fdget(fd)) == NULL)
     return -1;
   if (pfd)
     *pfd = fd;
@@ -141,19 +57,78 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct fdtable *t = myproc()->fdt;
 
+  // 描述符表可能被 CLONE_FILES 线程共享，占用空位需加锁
+  acquire(&t->lock);
   for (fd = 0; fd < NOFILE; fd++)
   {
-    if (p->ofile[fd] == 0)
+    if (t->ofile[fd] == 0)
     {
-      p->ofile[fd] = f;
+      t->ofile[fd] = f;
+      release(&t->lock);
       return fd;
     }
   }
+  release(&t->lock);
   return -1;
 }
 
+// 撤销 fdalloc 刚放入 fd 的 f 并关闭它。其间若已有线程关闭或替换了 fd，
+// f 的引用已随之处理，这里不再动它。
+static void
+fdundo(int fd, struct file *f)
+{
+  struct fdtable *t = myproc()->fdt;
+
+  acquire(&t->lock);
+  if (t->ofile[fd] != f)
+  {
+    release(&t->lock);
+    return;
+  }
+  t->ofile[fd] = 0;
+  release(&t->lock);
+  fileclose(f);
+}
+
+// 把 f 放入描述符 fd，原先打开的文件在锁外关闭。
+static void
+fdreplace(int fd, struct file *f)
+{
+  struct fdtable *t = myproc()->fdt;
+  struct file *old;
+
+  acquire(&t->lock);
+  old = t->ofile[fd];
+  t->ofile[fd] = f;
+  release(&t->lock);
+  if (old)
+    fileclose(old);
+}
+
+// 释放描述符 fd 并关闭其文件。共享描述符表的线程可能同时关闭同一个 fd，
+// 只有真正清空该槽位的一方负责 fileclose。
+static int
+fdclose(int fd)
+{
+  struct fdtable *t = myproc()->fdt;
+  struct file *f;
+
+  if (fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&t->lock);
+  if ((f = t->ofile[fd]) == NULL)
+  {
+    release(&t->lock);
+    return -1;
+  }
+  t->ofile[fd] = 0;
+  release(&t->lock);
+  fileclose(f);
+  return 0;
+}
+
 /**
  * 复制一个文件描述符。
  *
@@ -208,6 +183,175 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// 从用户地址 addr 处取出 iovcnt 个 iovec 到 iov 中。
+static int
+argiov(uint64 addr, int iovcnt, struct iovec *iov)
+{
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  return copyin2((char *)iov, addr, iovcnt * sizeof(struct iovec));
+}
+
+/**
+ * 把文件数据依次读入多个用户缓冲区，一次系统调用完成。
+ *
+ * 参数说明：
+ *   - fd (int): 文件描述符
+ *   - iov (struct iovec *): 缓冲区数组
+ *   - iovcnt (int): 缓冲区个数，不超过 IOV_MAX
+ * 返回值：
+ *   - uint64: 实际读取的总字节数，失败返回-1
+ */
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 p;
+  int cnt;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &cnt) < 0)
+    return -1;
+  if (argiov(p, cnt, iov) < 0)
+    return -1;
+  return filerwv(f, iov, cnt, 0, NULL);
+}
+
+/**
+ * 把多个用户缓冲区的数据依次写入文件，一次系统调用完成。
+ *
+ * 参数同 readv。
+ * 返回值：
+ *   - uint64: 实际写入的总字节数，失败返回-1
+ */
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 p;
+  int cnt;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &cnt) < 0)
+    return -1;
+  if (argiov(p, cnt, iov) < 0)
+    return -1;
+  return filerwv(f, iov, cnt, 1, NULL);
+}
+
+/**
+ * 从文件的指定偏移处读取，不使用也不修改文件自身的偏移。
+ *
+ * 参数说明：
+ *   - fd (int): 文件描述符，须为普通文件
+ *   - buf (void *): 用户缓冲区
+ *   - count (int): 读取的字节数
+ *   - offset (uint): 文件偏移
+ * 返回值：
+ *   - uint64: 实际读取的字节数，失败返回-1
+ */
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n;
+  uint off;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, (uint64 *)&iov.iov_base) < 0 ||
+      argint(2, &n) < 0 || argint(3, (int *)&off) < 0 || n < 0)
+    return -1;
+  iov.iov_len = n;
+  return filerwv(f, &iov, 1, 0, &off);
+}
+
+/**
+ * 向文件的指定偏移处写入，不使用也不修改文件自身的偏移。
+ *
+ * 参数同 pread。
+ * 返回值：
+ *   - uint64: 实际写入的字节数，失败返回-1
+ */
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n;
+  uint off;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, (uint64 *)&iov.iov_base) < 0 ||
+      argint(2, &n) < 0 || argint(3, (int *)&off) < 0 || n < 0)
+    return -1;
+  iov.iov_len = n;
+  return filerwv(f, &iov, 1, 1, &off);
+}
+
+/**
+ * readv 的定位版本：从指定偏移处读入多个缓冲区，文件自身偏移不变。
+ *
+ * 参数说明：
+ *   - fd, iov, iovcnt: 同 readv
+ *   - offset (uint): 文件偏移
+ * 返回值：
+ *   - uint64: 实际读取的总字节数，失败返回-1
+ */
+uint64
+sys_preadv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 p;
+  int cnt;
+  uint off;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &cnt) < 0 ||
+      argint(3, (int *)&off) < 0)
+    return -1;
+  if (argiov(p, cnt, iov) < 0)
+    return -1;
+  return filerwv(f, iov, cnt, 0, &off);
+}
+
+/**
+ * writev 的定位版本：把多个缓冲区写到指定偏移处，文件自身偏移不变。
+ *
+ * 参数同 preadv。
+ * 返回值：
+ *   - uint64: 实际写入的总字节数，失败返回-1
+ */
+uint64
+sys_pwritev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 p;
+  int cnt;
+  uint off;
+
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &p) < 0 || argint(2, &cnt) < 0 ||
+      argint(3, (int *)&off) < 0)
+    return -1;
+  if (argiov(p, cnt, iov) < 0)
+    return -1;
+  return filerwv(f, iov, cnt, 1, &off);
+}
+
+/**
+ * 把文件的目录项（大小、首簇）写回磁盘。
+ *
+ * @return uint64: 成功返回0，失败返回-1。
+ */
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if (argfd(0, 0, &f) < 0)
+    return -1;
+  return filesync(f);
+}
+
 /**
  * 关闭一个文件描述符。
  *
@@ -224,9 +368,7 @@ sys_close(void)
     printf("close fd: %d\n", argfd(0, &fd, &f));
     return -1;
   }
-  myproc()->ofile[fd] = 0;
-  fileclose(f);
-  return 0;
+  return fdclose(fd);
 }
 
 struct kstat
@@ -263,8 +405,9 @@ uint64 sys_fstat(void)
   uint64 addr;
   if (argint(0, &fd) < 0 || argaddr(1, &addr) < 0)
     return -1;
-  struct proc *p = myproc();
-  struct file *f = p->ofile[fd];
+  struct file *f = fdget(fd);
+  if (f == NULL || f->type != FD_ENTRY)
+    return -1;
   struct dirent *ep = f->ep;
   struct kstat *st = {0};
   st->st_dev = ep->dev;
@@ -282,18 +425,19 @@ uint64 sys_fstat(void)
 /**
  * 创建一个新的目录项（文件或目录）。
  *
+ * @param base (struct dirent*): 相对路径的起点目录，为NULL时使用当前目录。
  * @param path (char*): 路径。
  * @param type (short): 类型（T_FILE 或 T_DIR）。
  * @param mode (int): 模式。
  * @return struct dirent*: 成功返回新目录项指针，失败返回NULL。
  */
 static struct dirent *
-create(char *path, short type, int mode)
+create(struct dirent *base, char *path, short type, int mode)
 {
   struct dirent *ep, *dp;
   char name[FAT32_MAX_FILENAME + 1];
 
-  if ((dp = enameparent(path, name)) == NULL)
+  if ((dp = enameparentat(base, path, name)) == NULL)
     return NULL;
 
   if (type == T_DIR)
@@ -333,25 +477,18 @@ create(char *path, short type, int mode)
   return ep;
 }
 
-/**
- * 打开一个文件。
- *
- * @return uint64: 成功返回文件描述符，失败返回-1。
- */
-uint64
-sys_open(void)
+// 按 omode 打开 path，返回新的文件描述符，失败返回-1。
+// 相对路径从 base 开始解析，base 为NULL时从当前目录开始。
+static int
+openpath(struct dirent *base, char *path, int omode)
 {
-  char path[FAT32_MAX_PATH];
-  int fd, omode;
+  int fd;
   struct file *f;
   struct dirent *ep;
 
-  if (argstr(0, path, FAT32_MAX_PATH) < 0 || argint(1, &omode) < 0)
-    return -1;
-
   if (omode & O_CREATE)
   {
-    ep = create(path, T_FILE, omode);
+    ep = create(base, path, T_FILE, omode);
     if (ep == NULL)
     {
       return -1;
@@ -359,12 +496,12 @@ sys_open(void)
   }
   else
   {
-    if ((ep = ename(path)) == NULL)
+    if ((ep = enameat(base, path)) == NULL)
     {
       return -1;
     }
     elock(ep);
-    if ((ep->attribute & ATTR_DIRECTORY) && omode != O_RDONLY)
+    if ((ep->attribute & ATTR_DIRECTORY) && (omode & (O_WRONLY | O_RDWR)))
     {
       eunlock(ep);
       eput(ep);
@@ -400,7 +537,49 @@ sys_open(void)
 }
 
 /**
- * 以指定目录为基础打开文件。
+ * 打开一个文件。
+ *
+ * @return uint64: 成功返回文件描述符，失败返回-1。
+ */
+uint64
+sys_open(void)
+{
+  char path[FAT32_MAX_PATH];
+  int omode;
+
+  if (argstr(0, path, FAT32_MAX_PATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openpath(NULL, path, omode);
+}
+
+/**
+ * 取得 *at 系列调用中相对路径的起点目录。
+ * 绝对路径或 dirfd 为 AT_FDCWD 时 *pbase 为NULL，表示使用当前目录。
+ *
+ * @param dirfd (int): 目录的文件描述符。
+ * @param path (char*): 路径。
+ * @param pbase (struct dirent**): 返回起点目录项。
+ * @return int: 成功返回0，dirfd 无效或不是目录时返回-1。
+ */
+static int
+atbase(int dirfd, char *path, struct dirent **pbase)
+{
+  struct file *f;
+
+  *pbase = NULL;
+  if (*path == '/' || dirfd == AT_FDCWD)
+    return 0;
+  if ((f = fdget(dirfd)) == NULL)
+    return -1;
+  if (f->type != FD_ENTRY || !(f->ep->attribute & ATTR_DIRECTORY))
+    return -1;
+  *pbase = f->ep;
+  return 0;
+}
+
+/**
+ * 以指定目录为基础打开文件。相对路径直接从 dirfd 对应的目录开始解析，
+ * 不再拼接成绝对路径后从根目录重新查找。
  *
  * @return uint64: 成功返回文件描述符，失败返回-1。
  */
@@ -410,72 +589,14 @@ uint64 sys_openat(void)
   char path[FAT32_MAX_PATH];
   int flags;
   int mode;
-  struct dirent *ep;
-  struct file *f;
+  struct dirent *base;
   if (argint(0, &fd) < 0 || argstr(1, path, FAT32_MAX_PATH) < 0 || argint(2, &flags) < 0 || argint(3, &mode) < 0)
     return -1;
   if (*path == '\0')
     return -1;
-
-  if (get_path(path, fd) < 0)
-  {
-    printf("error in openat\n");
-    return -1;
-  }
-
-  int new_fd;
-  if (flags & O_CREATE)
-  {
-    ep = create(path, T_FILE, flags);
-    if (ep == NULL)
-    {
-      printf("creat null: %d\n", flags);
-      return -1;
-    }
-  }
-  else
-  {
-    if ((ep = ename(path)) == NULL)
-    {
-      return -1;
-    }
-    elock(ep);
-    if ((ep->attribute & ATTR_DIRECTORY) && (flags & O_WRONLY))
-    {
-      eunlock(ep);
-      eput(ep);
-      printf("show O_DIRECTORY: %d \n", flags);
-      printf("abs_path=%s\n", path);
-      return -1;
-    }
-  }
-
-  if ((f = filealloc()) == NULL || (new_fd = fdalloc(f)) < 0)
-  {
-    if (f)
-    {
-      fileclose(f);
-    }
-    eunlock(ep);
-    eput(ep);
-    printf("unable to open: %d\n", flags);
+  if (atbase(fd, path, &base) < 0)
     return -1;
-  }
-
-  if (!(ep->attribute & ATTR_DIRECTORY) && (flags & O_TRUNC))
-  {
-    etrunc(ep);
-  }
-
-  f->type = FD_ENTRY;
-  f->off = (flags & O_APPEND) ? ep->file_size : 0;
-  f->ep = ep;
-  f->readable = !(flags & O_WRONLY);
-  f->writable = (flags & O_WRONLY) || (flags & O_RDWR);
-
-  eunlock(ep);
-
-  return new_fd;
+  return openpath(base, path, flags);
 }
 
 /**
@@ -489,7 +610,7 @@ sys_mkdir(void)
   char path[FAT32_MAX_PATH];
   struct dirent *ep;
 
-  if (argstr(0, path, FAT32_MAX_PATH) < 0 || (ep = create(path, T_DIR, 0)) == 0)
+  if (argstr(0, path, FAT32_MAX_PATH) < 0 || (ep = create(NULL, path, T_DIR, 0)) == 0)
   {
     return -1;
   }
@@ -518,14 +639,9 @@ sys_mkdirat(void)
   if (*path == '\0')
     return -1;
 
-  if (get_path(path, dirfd) < 0)
-  {
-    printf("error in mkdirat\n");
+  struct dirent *base, *ep;
+  if (atbase(dirfd, path, &base) < 0 || (ep = create(base, path, T_DIR, 0)) == NULL)
     return -1;
-  }
-
-  struct dirent *ep;
-  ep = create(path, T_DIR, 0);
   eunlock(ep);
   eput(ep);
   return 0;
@@ -571,7 +687,6 @@ sys_pipe(void)
   uint64 fdarray;            // 用户空间的指针，指向两个整数的数组
   struct file *rf, *wf;      // rf: 读端文件结构指针, wf: 写端文件结构指针
   int fd0, fd1;              // fd0: 读端文件描述符, fd1: 写端文件描述符
-  struct proc *p = myproc(); // 当前进程指针
 
   // 获取用户传入的 fdarray 参数
   if (argaddr(0, &fdarray) < 0)
@@ -585,8 +700,9 @@ sys_pipe(void)
   {
     // 如果只分配了读端描述符，回收
     if (fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
+      fdundo(fd0, rf);
+    else
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
@@ -595,10 +711,8 @@ sys_pipe(void)
       copyout2(fdarray + sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0)
   {
     // 回收已分配的文件描述符和 file 结构
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    fdundo(fd0, rf);
+    fdundo(fd1, wf);
     return -1;
   }
   return 0;
@@ -865,7 +979,7 @@ sys_rename(void)
   struct dirent *psrc = src->parent; // src must not be root, or it won't pass the for-loop test
   src->parent = edup(pdst);
   src->off = off;
-  src->valid = 1;
+  ehash(src);
   eunlock(src);
 
   eput(psrc);
@@ -912,19 +1026,251 @@ sys_dup3(void)
   // printf("old_fd: %d, new_fd: %d\n", old_fd, new_fd);
   // printf("NOFILE: %d\n", NOFILE);
   // 检查 new_fd 是否在合法范围内
-  if (new_fd < 0 || new_fd > NOFILE)
+  if (new_fd < 0 || new_fd >= NOFILE)
     return -1;
 
-  // 如果 new_fd 已经打开，先关闭它
-  if (myproc()->ofile[new_fd])
+  // 增加引用计数后放入 new_fd，new_fd 原先打开的文件随之关闭
+  filedup(f);
+  fdreplace(new_fd, f);
+  return new_fd;
+}
+
+/**
+ * 文件描述符控制。目前支持查询和调整管道缓冲区大小。
+ *
+ * 参数说明：
+ *   - fd (int): 文件描述符
+ *   - cmd (int): F_GETPIPE_SZ 或 F_SETPIPE_SZ
+ *   - arg (int): F_SETPIPE_SZ 时为期望的缓冲区字节数
+ * 返回值：
+ *   - uint64: 成功返回管道当前容量（字节），失败返回-1
+ */
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if (argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+
+  switch (cmd)
   {
-    fileclose(myproc()->ofile[new_fd]);
+  case F_GETPIPE_SZ:
+    if (f->type != FD_PIPE)
+      return -1;
+    return pipegetsize(f->pipe);
+  case F_SETPIPE_SZ:
+    if (f->type != FD_PIPE)
+      return -1;
+    return pipesetsize(f->pipe, arg);
   }
+  return -1;
+}
 
-  // 将文件结构指针 f 赋值给 new_fd，并增加引用计数
-  myproc()->ofile[new_fd] = f;
-  filedup(f);
-  return new_fd;
+// 执行一个批量请求，返回值与对应的系统调用相同。
+static int
+ioring_do(struct io_sqe *sqe)
+{
+  struct file *f = NULL;
+  struct iovec iov;
+  char path[FAT32_MAX_PATH];
+  uint off = sqe->off;
+
+  if (sqe->opcode == IORING_OP_NOP)
+    return 0;
+  if (sqe->opcode == IORING_OP_OPEN) {
+    if (fetchstr(sqe->addr, path, FAT32_MAX_PATH) < 0)
+      return -1;
+    return openpath(NULL, path, sqe->len);
+  }
+  if ((f = fdget(sqe->fd)) == NULL)
+    return -1;
+  switch (sqe->opcode) {
+  case IORING_OP_READ:
+  case IORING_OP_WRITE:
+    iov.iov_base = (void *)sqe->addr;
+    iov.iov_len = sqe->len;
+    return filerwv(f, &iov, 1, sqe->opcode == IORING_OP_WRITE,
+                   (sqe->flags & IOSQE_FIXED_OFF) ? &off : NULL);
+  case IORING_OP_CLOSE:
+    return fdclose(sqe->fd);
+  case IORING_OP_FSYNC:
+    return filesync(f);
+  }
+  return -1;
+}
+
+/**
+ * 批量执行共享环中已提交的请求，一次陷入完成全部操作。
+ * 进程在 ring->sq 中填好请求并推进 sq_tail 后调用；内核依次执行
+ * sq_head 到 sq_tail 之间的请求，把结果写入 ring->cq 并推进 cq_tail，
+ * 完成队列满时提前停止。
+ *
+ * 参数说明：
+ *   - ring (struct io_ring *): 进程内存中的共享环
+ * 返回值：
+ *   - uint64: 本次执行的请求数；环中地址不可访问时在此停下，
+ *     一个也未执行则返回-1。已执行但完成项写不回的请求也出队并计入
+ */
+uint64
+sys_ioring_enter(void)
+{
+  uint64 addr;
+  struct io_ring *ring;
+  uint32 idx[4];  // sq_head, sq_tail, cq_head, cq_tail
+  struct io_sqe sqe;
+  struct io_cqe cqe;
+  int n = 0, bad = 0;
+
+  if (argaddr(0, &addr) < 0 || addr + sizeof(struct io_ring) < addr ||
+      addr + sizeof(struct io_ring) > myproc()->sz ||
+      copyin2((char *)idx, addr, sizeof(idx)) < 0)
+    return -1;
+  ring = (struct io_ring *)addr;  // only used for address arithmetic
+  if (idx[1] - idx[0] > IORING_ENTRIES)
+    return -1;
+
+  while (idx[0] != idx[1] && idx[3] - idx[2] < IORING_ENTRIES) {
+    if (copyin2((char *)&sqe, (uint64)&ring->sq[idx[0] % IORING_ENTRIES], sizeof(sqe)) < 0)
+    {
+      bad = 1;
+      break;
+    }
+    cqe.user_data = sqe.user_data;
+    cqe.res = ioring_do(&sqe);
+    fdrelease();  // 每个请求的文件引用用完即放，不随请求数累积
+    cqe.pad = 0;
+    // 结果写不回去时请求已经执行，仍要出队并计数，以免下次重复执行；
+    // 只是它的完成项丢失，停在这里
+    if (copyout2((uint64)&ring->cq[idx[3] % IORING_ENTRIES], (char *)&cqe, sizeof(cqe)) < 0)
+    {
+      idx[0]++;
+      n++;
+      bad = 1;
+      break;
+    }
+    idx[0]++;
+    idx[3]++;
+    n++;
+    if (myproc()->killed)
+      break;
+  }
+  if (copyout2((uint64)&ring->sq_head, (char *)&idx[0], sizeof(uint32)) < 0 ||
+      copyout2((uint64)&ring->cq_tail, (char *)&idx[3], sizeof(uint32)) < 0)
+    bad = 1;
+  return bad && n == 0 ? -1 : n;
+}
+
+// 在内核中把数据从 in 搬到 out。offaddr 非 0 时从用户指针读取文件偏移，
+// 传输结束后写回，f->off 保持不变；为 0 时使用并推进 f->off。
+static int
+dosplice(struct file *in, uint64 inaddr, struct file *out, uint64 outaddr, int n, int peek)
+{
+  uint inoff, outoff;
+  uint *pin = &in->off, *pout = &out->off;
+  int r;
+
+  // 同一管道的两端会让写者等待它自己读出
+  if (in == out || (in->type == FD_PIPE && out->type == FD_PIPE && in->pipe == out->pipe))
+    return -1;
+  if (inaddr) {
+    if (in->type != FD_ENTRY || copyin2((char *)&inoff, inaddr, sizeof(inoff)) < 0)
+      return -1;
+    pin = &inoff;
+  }
+  if (outaddr) {
+    if (out->type != FD_ENTRY || copyin2((char *)&outoff, outaddr, sizeof(outoff)) < 0)
+      return -1;
+    pout = &outoff;
+  }
+  if ((r = filesplice(in, pin, out, pout, n, peek)) < 0)
+    return -1;
+  if ((inaddr && copyout2(inaddr, (char *)&inoff, sizeof(inoff)) < 0) ||
+      (outaddr && copyout2(outaddr, (char *)&outoff, sizeof(outoff)) < 0))
+    return -1;
+  return r;
+}
+
+/**
+ * 在两个文件描述符之间直接搬运数据，不经过用户缓冲区。
+ * 至少一端须为管道；管道一端在环形缓冲区上原地读写。
+ *
+ * 参数说明：
+ *   - fd_in (int): 输入文件描述符
+ *   - off_in (uint *): 输入文件偏移，为 0 时使用并推进文件自身偏移
+ *   - fd_out (int): 输出文件描述符
+ *   - off_out (uint *): 输出文件偏移，同上
+ *   - len (int): 最多搬运的字节数
+ *   - flags (int): 保留，须为 0
+ * 返回值：
+ *   - uint64: 成功返回搬运的字节数（0 表示输入结束），失败返回-1
+ */
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  uint64 inaddr, outaddr;
+  int len, flags;
+
+  if (argfd(0, 0, &in) < 0 || argaddr(1, &inaddr) < 0 ||
+      argfd(2, 0, &out) < 0 || argaddr(3, &outaddr) < 0 ||
+      argint(4, &len) < 0 || argint(5, &flags) < 0)
+    return -1;
+  if (flags != 0 || (in->type != FD_PIPE && out->type != FD_PIPE))
+    return -1;
+  return dosplice(in, inaddr, out, outaddr, len, 0);
+}
+
+/**
+ * 把管道 fd_in 中的数据复制到管道 fd_out，但不从 fd_in 中取走。
+ *
+ * 参数说明：
+ *   - fd_in (int): 输入管道
+ *   - fd_out (int): 输出管道，不能与 fd_in 为同一管道
+ *   - len (int): 最多复制的字节数
+ *   - flags (int): 保留，须为 0
+ * 返回值：
+ *   - uint64: 成功返回复制的字节数，失败返回-1
+ */
+uint64
+sys_tee(void)
+{
+  struct file *in, *out;
+  int len, flags;
+
+  if (argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 ||
+      argint(2, &len) < 0 || argint(3, &flags) < 0)
+    return -1;
+  if (flags != 0 || in->type != FD_PIPE || out->type != FD_PIPE || in->pipe == out->pipe)
+    return -1;
+  return dosplice(in, 0, out, 0, len, 1);
+}
+
+/**
+ * 把普通文件 in_fd 的内容直接发送到 out_fd（管道、控制台或文件）。
+ *
+ * 参数说明：
+ *   - out_fd (int): 输出文件描述符
+ *   - in_fd (int): 输入文件描述符，须为普通文件
+ *   - offset (uint *): 读取偏移，为 0 时使用并推进 in_fd 自身偏移
+ *   - count (int): 最多发送的字节数
+ * 返回值：
+ *   - uint64: 成功返回发送的字节数，失败返回-1
+ */
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  uint64 offaddr;
+  int count;
+
+  if (argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+      argaddr(2, &offaddr) < 0 || argint(3, &count) < 0)
+    return -1;
+  if (in->type != FD_ENTRY || (in->ep->attribute & ATTR_DIRECTORY))
+    return -1;
+  return dosplice(in, offaddr, out, 0, count, 0);
 }
 
 /**
@@ -970,8 +1316,8 @@ uint64 sys_munmap(void)
     return -1;
   }
 
-  // 解除映射，不释放物理内存
-  vmunmap(p->pagetable, addr, npages, 0);
+  // 解除映射并释放物理页（页缓存中的页只减少一个引用）
+  munmapproc(addr, npages);
 
   return 0;
 }
@@ -1006,23 +1352,24 @@ uint64 sys_mmap(void)
       argint(5, &off) < 0)
     return -1;
 
-  struct proc *p = myproc();
-
   // 检查文件描述符合法性
-  if (fd < 0 || fd >= NOFILE)
-    return -1;
-  struct file *f = p->ofile[fd];
+  struct file *f = fdget(fd);
   if (f == NULL || f->type != FD_ENTRY || f->ep == NULL)
     return -1;
 
+  // 只读映射直接映射页缓存中的文件页，与其他读者共享
+  if (addr == 0 && !(prot & PROT_WRITE) && off >= 0 && off % PGSIZE == 0)
+  {
+    if (off >= f->ep->file_size)
+      return -1;
+    return mmapfile(f->ep, off, len);
+  }
+
   // 如果未指定地址，则自动分配在进程末尾
   if (addr == 0)
   {
-    addr = PGROUNDUP(p->sz);
-    uint64 new_sz = addr + len;
-    if (uvmalloc(p->pagetable, p->kpagetable, p->sz, new_sz) == 0)
+    if ((addr = growmmap(len)) == -1)
       return -1;
-    p->sz = new_sz;
   }
 
   // 计算实际可映射的长度，防止越界
@@ -1048,36 +1395,45 @@ uint64 sys_mmap(void)
   return addr;
 }
 
-// 兼容 Linux 的目录项结构体
-struct linux_dirent64
-{
-  uint64 d_ino;            // inode 号
-  uint64 d_off;            // 下一个目录项的偏移
-  unsigned short d_reclen; // 目录项长度
-  unsigned char d_type;    // 文件类型
-  char d_name[];           // 文件名
-};
-
 /**
  * 获取目录项信息，类似于 Linux 的 getdents64。
+ * 可多次调用分批读取大目录，读到目录末尾时返回0。
  *
  * @return uint64: 实际读取的字节数，失败返回-1。
  */
 uint64 sys_getdents(void)
 {
-  int fd, len;
+  struct file *f;
+  int len;
   uint64 buf;
 
   // 获取参数，若有错误则返回-1
-  if (argint(0, &fd) < 0 || argaddr(1, &buf) < 0 || argint(2, &len) < 0)
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &buf) < 0 || argint(2, &len) < 0)
+    return -1;
+  if (f->type != FD_ENTRY || !f->readable)
     return -1;
 
-  struct proc *p = myproc();
-  struct file *f = p->ofile[fd];
-  struct dirent *ep = f->ep;
+  // 从 f->off 记录的目录偏移处继续读取，并推进 f->off
+  return getdents64(f->ep, &f->off, buf, len);
+}
+
+/**
+ * 批量读取目录项及其大小、首簇号（readdirplus），游标同样保存在 f->off。
+ * 遍历大目录时不必再对每个子项 open/fstat。
+ *
+ * @return uint64: 实际读取的字节数，目录结束返回0，失败返回-1。
+ */
+uint64 sys_readdirplus(void)
+{
+  struct file *f;
+  int len;
+  uint64 buf;
 
-  // 调用 getdents64 获取目录项
-  return getdents64(ep, buf, len);
+  if (argfd(0, 0, &f) < 0 || argaddr(1, &buf) < 0 || argint(2, &len) < 0)
+    return -1;
+  if (f->type != FD_ENTRY || !f->readable)
+    return -1;
+  return readdirplus(f->ep, &f->off, buf, len);
 }
 
 /**
@@ -1114,16 +1470,16 @@ uint64 sys_unlink(void)
     return -1;
   }
 
-  // 解析路径，支持相对/绝对路径
-  if (get_path(path, dirfd) < 0)
+  // 相对路径从 dirfd 对应的目录开始解析
+  struct dirent *base, *ep = NULL;
+  if (atbase(dirfd, path, &base) < 0)
   {
-    printf("error in unlinkat: invalid path\n");
+    printf("error in unlinkat: invalid dirfd\n");
     return -1;
   }
 
-  struct dirent *ep = NULL;
   // 查找目标目录项
-  ep = ename(path);
+  ep = enameat(base, path);
   if (ep == NULL)
   {
     printf("error in unlinkat: target not found\n");
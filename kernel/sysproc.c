@@ -10,6 +10,9 @@
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/vm.h"
+#include "include/futex.h"
+#include "include/sched.h"
+#include "include/kprof.h"
 
 extern int exec(char *path, char **argv);
 
@@ -241,6 +244,74 @@ uint64 sys_clone(void)
   return clone();
 }
 
+/**
+ * @brief Wait on or wake a word of user memory.
+ *
+ * FUTEX_WAIT sleeps while the int at uaddr still holds val;
+ * FUTEX_WAKE wakes at most val threads waiting on uaddr.
+ *
+ * @return uint64: 0 after a wait is woken, the number of threads
+ *         woken for FUTEX_WAKE, or -1 on error (including a wait
+ *         whose word no longer held val).
+ */
+uint64 sys_futex(void)
+{
+  uint64 uaddr;
+  int op, val;
+
+  if (argaddr(0, &uaddr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+
+  switch (op & ~FUTEX_PRIVATE_FLAG)
+  {
+  case FUTEX_WAIT:
+    return futexwait(uaddr, val);
+  case FUTEX_WAKE:
+    return futexwake(uaddr, val);
+  }
+  return -1;
+}
+
+/**
+ * @brief Control the timer-driven sampling profiler.
+ *
+ * KPROF_START clears the sample buffers and starts sampling,
+ * KPROF_STOP stops it, KPROF_READ moves up to n samples to buf,
+ * KPROF_DROPPED counts the samples lost to full buffers.
+ *
+ * @return uint64: the number of samples read for KPROF_READ, the
+ *         count for KPROF_DROPPED, 0 otherwise, or -1 on error.
+ */
+uint64 sys_kprof(void)
+{
+  uint64 addr;
+  int op, n;
+
+  if (argint(0, &op) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+  return kprofctl(op, addr, n);
+}
+
+/**
+ * @brief Report lock contention statistics.
+ *
+ * Copies out up to n struct lockstat entries, one per lock name and
+ * type that has been acquired, then clears all counters if reset is
+ * set. Statistics are only kept by kernels built with lockstat=1.
+ *
+ * @return uint64: the number of entries copied, or -1 on error or if
+ * statistics are not kept.
+ */
+uint64 sys_lockstat(void)
+{
+  uint64 addr;
+  int n, reset;
+
+  if (argaddr(0, &addr) < 0 || argint(1, &n) < 0 || argint(2, &reset) < 0)
+    return -1;
+  return lockstat_copy(addr, n, reset);
+}
+
 /**
  * @brief Get the parent process ID of the calling process.
  *
@@ -12,6 +12,8 @@
 #include "include/console.h"
 #include "include/timer.h"
 #include "include/disk.h"
+#include "include/kprof.h"
+#include "include/swap.h"
 
 extern char trampoline[], uservec[], userret[];
 
@@ -20,6 +22,19 @@ extern void kernelvec();
 
 int devintr();
 
+// The access an instruction, load or store page fault was making,
+// as the PTE permission it needs, or 0 if scause isn't one of them.
+static int
+faultperm(uint64 scause)
+{
+  switch(scause){
+  case 12: return PTE_X;
+  case 13: return PTE_R;
+  case 15: return PTE_W;
+  }
+  return 0;
+}
+
 // void
 // trapinit(void)
 // {
@@ -80,6 +95,18 @@ usertrap(void)
   else if((which_dev = devintr()) != 0){
     // ok
   } 
+  else if(faultperm(r_scause()) != 0){
+    uint64 scause = r_scause(), va = r_stval();
+    intr_on();
+    // on failure memory may just be short: page some of ours out
+    // to make room and try once more.
+    if(pagefault(va, faultperm(scause)) < 0 &&
+       (swapout(1, 1) == 0 || pagefault(va, faultperm(scause)) < 0)){
+      printf("\nusertrap(): page fault %p pid=%d %s\n", scause, p->pid, p->name);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, va);
+      p->killed = 1;
+    }
+  }
   else {
     printf("\nusertrap(): unexpected scause %p pid=%d %s\n", r_scause(), p->pid, p->name);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -91,8 +118,12 @@ usertrap(void)
     exit(-1);
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // parked at the user boundary, its pages can go to swap meanwhile.
+  if(which_dev == 2){
+    p->atuser = 1;
     yield();
+    p->atuser = 0;
+  }
 
   usertrapret();
 }
@@ -151,13 +182,18 @@ kerneltrap() {
   uint64 sepc = r_sepc();
   uint64 sstatus = r_sstatus();
   uint64 scause = r_scause();
+  int perm = faultperm(scause);
   
   if((sstatus & SSTATUS_SPP) == 0)
     panic("kerneltrap: not from supervisor mode");
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
-  if((which_dev = devintr()) == 0){
+  // the kernel touching user memory exec() left unloaded.
+  if(perm && myproc() != 0 && pagefault(r_stval(), perm) == 0){
+    // ok
+  }
+  else if((which_dev = devintr()) == 0){
     printf("\nscause %p\n", scause);
     printf("sepc=%p stval=%p hart=%d\n", r_sepc(), r_stval(), r_tp());
     struct proc *p = myproc();
@@ -221,6 +257,8 @@ int devintr(void) {
 		return 1;
 	}
 	else if (0x8000000000000005L == scause) {
+		// sepc and SPP still describe the interrupted context.
+		kprof_tick(r_sepc(), (r_sstatus() & SSTATUS_SPP) == 0);
 		timer_tick();
 		return 2;
 	}
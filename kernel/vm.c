@@ -8,12 +8,17 @@
 #include "include/proc.h"
 #include "include/printf.h"
 #include "include/string.h"
+#include "include/spinlock.h"
+#include "include/swap.h"
 
 /*
  * the kernel's page table.
  */
 pagetable_t kernel_pagetable;
 
+// guards cpus[].pagetable and ptfree; see kvmswitch().
+struct spinlock ptlock;
+
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 extern char trampoline[]; // trampoline.S
 /*
@@ -24,6 +29,7 @@ kvminit()
 {
   kernel_pagetable = (pagetable_t) kalloc();
   // printf("kernel_pagetable: %p\n", kernel_pagetable);
+  initlock(&ptlock, "ptlock");
 
   memset(kernel_pagetable, 0, PGSIZE);
 
@@ -94,6 +100,12 @@ kvminithart()
   w_satp(MAKE_SATP(kernel_pagetable));
   // reg_info();
   sfence_vma();
+  #ifdef QEMU
+  // the kernel runs on the process page table and dereferences user
+  // pointers there directly (copyin2() etc.). K210's older privileged
+  // spec has PUM in this bit instead, clear by default, which allows it.
+  w_sstatus(r_sstatus() | SSTATUS_SUM);
+  #endif
   #ifdef DEBUG
   printf("kvminithart\n");
   #endif
@@ -121,11 +133,16 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(*pte & (PTE_R|PTE_W|PTE_X)){  // a megapage leaf maps va
+        if(alloc)
+          panic("walk: megapage");
+        return pte;
+      }
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
       if(!alloc || (pagetable = (pde_t*)kalloc()) == NULL)
         return NULL;
-      memset(pagetable, 0, PGSIZE);
+      pagezero(pagetable);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
@@ -155,14 +172,55 @@ walkaddr(pagetable_t pagetable, uint64 va)
   return pa;
 }
 
-// add a mapping to the kernel page table.
-// only used when booting.
+// Map the megapage at va to pa with a level-1 leaf PTE.
+// va and pa must be MEGAPGSIZE-aligned.
+static int
+megamap(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+  pagetable_t l1;
+
+  if(*pte & PTE_V){
+    l1 = (pagetable_t)PTE2PA(*pte);
+  } else {
+    if((l1 = (pagetable_t)kalloc()) == NULL)
+      return -1;
+    pagezero(l1);
+    *pte = PA2PTE(l1) | PTE_V;
+  }
+  pte = &l1[PX(1, va)];
+  if(*pte & PTE_V)
+    panic("remap");
+  *pte = PA2PTE(pa) | perm | PTE_V;
+  return 0;
+}
+
+// add a mapping to the kernel page table, with megapages
+// for every MEGAPGSIZE-aligned stretch the range fully covers
+// and 4 KiB pages for the rest. only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kernel_pagetable, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 n;
+  int err;
+
+  while(sz > 0){
+    if(va % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 && sz >= MEGAPGSIZE){
+      n = MEGAPGSIZE;
+      err = megamap(kernel_pagetable, va, pa, perm);
+    } else {
+      n = MEGAPGSIZE - va % MEGAPGSIZE;  // up to the next megapage
+      if(n > sz)
+        n = sz;
+      err = mappages(kernel_pagetable, va, n, pa, perm);
+    }
+    if(err != 0)
+      panic("kvmmap");
+    va += n;
+    pa += n;
+    sz -= n;
+  }
 }
 
 // translate a kernel virtual address to
@@ -178,17 +236,21 @@ kvmpa(uint64 va)
 uint64
 kwalkaddr(pagetable_t kpt, uint64 va)
 {
-  uint64 off = va % PGSIZE;
-  pte_t *pte;
-  uint64 pa;
-  
-  pte = walk(kpt, va, 0);
-  if(pte == 0)
-    panic("kvmpa");
-  if((*pte & PTE_V) == 0)
+  pte_t pte;
+  int level;
+
+  if(va >= MAXVA)
     panic("kvmpa");
-  pa = PTE2PA(*pte);
-  return pa+off;
+  for(level = 2; ; level--){
+    pte = kpt[PX(level, va)];
+    if((pte & PTE_V) == 0)
+      panic("kvmpa");
+    if((pte & (PTE_R|PTE_W|PTE_X)) || level == 0)
+      break;
+    kpt = (pagetable_t)PTE2PA(pte);
+  }
+  // a leaf above level 0 is a megapage: keep va's offset into it.
+  return PTE2PA(pte) + (va & ((1L << PXSHIFT(level)) - 1));
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -219,8 +281,8 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned. Pages never faulted in (see pagefault()) are
+// skipped. Optionally free the physical memory.
 void
 vmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
@@ -232,9 +294,13 @@ vmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("vmunmap: walk");
+      continue;
+    if(*pte & PTE_SWAP){  // paged out: let go of its slot
+      swapput(*pte);
+      *pte = 0;
+    }
     if((*pte & PTE_V) == 0)
-      panic("vmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("vmunmap: not a leaf");
     if(do_free){
@@ -245,8 +311,19 @@ vmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   }
 }
 
-// create an empty user page table.
-// returns 0 if out of memory.
+// Is top-level slot i of a process page table one it shares with
+// kernel_pagetable? The user slots below MAXUVA, the kernel stack
+// and the trampoline/trapframe slot are the process's own.
+static int
+kslot(int i)
+{
+  return i >= PX(2, MAXUVA) && i != PX(2, VKSTACK) && i != PX(2, TRAMPOLINE);
+}
+
+// create a user page table with no user memory that also maps
+// the kernel, so the kernel can run on it: the kernel's top-level
+// entries are copied, leaving the tables below them shared with
+// kernel_pagetable. returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
@@ -254,7 +331,8 @@ uvmcreate()
   pagetable = (pagetable_t) kalloc();
   if(pagetable == NULL)
     return NULL;
-  memset(pagetable, 0, PGSIZE);
+  for(int i = 0; i < 512; i++)
+    pagetable[i] = kslot(i) ? kernel_pagetable[i] : 0;
   return pagetable;
 }
 
@@ -262,7 +340,7 @@ uvmcreate()
 // for the very first process.
 // sz must be less than a page.
 void
-uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
+uvminit(pagetable_t pagetable, uchar *src, uint sz)
 {
   char *mem;
 
@@ -270,9 +348,8 @@ uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
     panic("inituvm: more than a page");
   mem = kalloc();
   // printf("[uvminit]kalloc: %p\n", mem);
-  memset(mem, 0, PGSIZE);
+  pagezero(mem);
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
-  mappages(kpagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X);
   memmove(mem, src, sz);
   // for (int i = 0; i < sz; i ++) {
   //   printf("[uvminit]mem: %p, %x\n", mem + i, mem[i]);
@@ -282,7 +359,7 @@ uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 uint64
-uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   char *mem;
   uint64 a;
@@ -294,19 +371,13 @@ uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 new
   for(a = oldsz; a < newsz; a += PGSIZE){
     mem = kalloc();
     if(mem == NULL){
-      uvmdealloc(pagetable, kpagetable, a, oldsz);
+      uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
+    pagezero(mem);
     if (mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0) {
       kfree(mem);
-      uvmdealloc(pagetable, kpagetable, a, oldsz);
-      return 0;
-    }
-    if (mappages(kpagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R) != 0){
-      int npages = (a - oldsz) / PGSIZE;
-      vmunmap(pagetable, oldsz, npages + 1, 1);   // plus the page allocated above.
-      vmunmap(kpagetable, oldsz, npages, 0);
+      uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
   }
@@ -318,14 +389,13 @@ uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 new
 // need to be less than oldsz.  oldsz can be larger than the actual
 // process size.  Returns the new process size.
 uint64
-uvmdealloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   if(newsz >= oldsz)
     return oldsz;
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    vmunmap(kpagetable, PGROUNDUP(newsz), npages, 0);
     vmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
   }
 
@@ -353,57 +423,124 @@ freewalk(pagetable_t pagetable)
 }
 
 // Free user memory pages,
-// then free page-table pages.
+// then free page-table pages, except those shared with
+// kernel_pagetable. Other mappings must already be removed.
 void
 uvmfree(pagetable_t pagetable, uint64 sz)
 {
+  struct cpu *c;
+
   if(sz > 0)
     vmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
-  freewalk(pagetable);
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if(kslot(i) || (pte & PTE_V) == 0)
+      continue;
+    if((pte & (PTE_R|PTE_W|PTE_X)) != 0)
+      panic("uvmfree: leaf");
+    freewalk((pagetable_t)PTE2PA(pte));
+    pagetable[i] = 0;
+  }
+
+  // The root may still be loaded by a scheduler() that ran this
+  // process last; leave it for that CPU to free when it moves on.
+  // Only its kernel slots matter then, and those stay intact.
+  int inuse = 0;
+  acquire(&ptlock);
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c->pagetable == pagetable){
+      c->ptfree = 1;
+      inuse = 1;
+    }
+  }
+  release(&ptlock);
+  if(!inuse)
+    kfree(pagetable);
 }
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory. Pages not faulted in yet
+// are left for the child to fault in itself;
+// read-only ones (shared text) are shared.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
-uvmcopy(pagetable_t old, pagetable_t new, pagetable_t knew, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
-  uint64 pa, i = 0, ki = 0;
+  pte_t *pte, *npte;
+  uint64 pa, i = 0;
   uint flags;
   char *mem;
 
   while (i < sz){
-    if((pte = walk(old, i, 0)) == NULL)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+    if((pte = walk(old, i, 0)) != NULL && (*pte & PTE_SWAP)){
+      // paged out: the child shares the swap slot.
+      if((npte = walk(new, i, 1)) == NULL)
+        goto err;
+      swapdup(*pte);
+      *npte = *pte;
+      i += PGSIZE;
+      continue;
+    }
+    if(pte == NULL || (*pte & PTE_V) == 0){
+      i += PGSIZE;
+      continue;
+    }
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == NULL)
+    if((flags & (PTE_W|PTE_U)) == PTE_U){
+      kdup((void*)pa);
+      mem = (char*)pa;
+    } else if((mem = kalloc()) == NULL)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
+    else
+      pagecopy(mem, (char*)pa);
     if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0) {
       kfree(mem);
       goto err;
     }
     i += PGSIZE;
-    if(mappages(knew, ki, PGSIZE, (uint64)mem, flags & ~PTE_U) != 0){
-      goto err;
-    }
-    ki += PGSIZE;
   }
   return 0;
 
  err:
-  vmunmap(knew, 0, ki / PGSIZE, 0);
   vmunmap(new, 0, i / PGSIZE, 1);
   return -1;
 }
 
+// Make new share the user memory of old instead of copying it.
+// Every top-level slot below MAXUVA of old first gets its level-1
+// table, so all later mappings land in tables the sharers point at
+// too and stay consistent across their page tables.
+// Returns 0 on success, -1 if a table can't be allocated.
+int
+uvmshare(pagetable_t old, pagetable_t new)
+{
+  pagetable_t t;
+
+  for(int i = 0; i < PX(2, MAXUVA); i++){
+    if((old[i] & PTE_V) == 0){
+      if((t = (pagetable_t)kalloc()) == NULL)
+        return -1;
+      pagezero(t);
+      old[i] = PA2PTE(t) | PTE_V;
+    }
+    new[i] = old[i];
+  }
+  return 0;
+}
+
+// Detach a page table from the user memory it shares, so that
+// freeing it leaves that memory to the other sharers.
+void
+uvmunshare(pagetable_t pagetable)
+{
+  for(int i = 0; i < PX(2, MAXUVA); i++)
+    pagetable[i] = 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -449,6 +586,10 @@ copyout2(uint64 dstva, char *src, uint64 len)
   if (dstva + len > sz || dstva >= sz) {
     return -1;
   }
+  // refuse read-only pages, such as text shared with other processes.
+  for(uint64 va = PGROUNDDOWN(dstva); va < dstva + len; va += PGSIZE)
+    if(pagefault(va, PTE_W) < 0)
+      return -1;
   memmove((void *)dstva, src, len);
   return 0;
 }
@@ -485,6 +626,10 @@ copyin2(char *dst, uint64 srcva, uint64 len)
   if (srcva + len > sz || srcva >= sz) {
     return -1;
   }
+  // bring in pages not loaded yet here, not from kerneltrap().
+  for(uint64 va = PGROUNDDOWN(srcva); va < srcva + len; va += PGSIZE)
+    if(pagefault(va, PTE_R) < 0)
+      return -1;
   memmove(dst, (void *)srcva, len);
   return 0;
 }
@@ -537,8 +682,12 @@ copyinstr2(char *dst, uint64 srcva, uint64 max)
 {
   int got_null = 0;
   uint64 sz = myproc()->sz;
+  uint64 start = srcva;
   while(srcva < sz && max > 0){
     char *p = (char *)srcva;
+    // entering a page: bring it in here, not from kerneltrap().
+    if((srcva == start || srcva % PGSIZE == 0) && pagefault(srcva, PTE_R) < 0)
+      return -1;
     if(*p == '\0'){
       *dst = '\0';
       got_null = 1;
@@ -557,70 +706,34 @@ copyinstr2(char *dst, uint64 srcva, uint64 max)
   }
 }
 
-// initialize kernel pagetable for each process.
-pagetable_t
-proc_kpagetable()
-{
-  pagetable_t kpt = (pagetable_t) kalloc();
-  if (kpt == NULL)
-    return NULL;
-  memmove(kpt, kernel_pagetable, PGSIZE);
-
-  // remap stack and trampoline, because they share the same page table of level 1 and 0
-  char *pstack = kalloc();
-  if(pstack == NULL)
-    goto fail;
-  if (mappages(kpt, VKSTACK, PGSIZE, (uint64)pstack, PTE_R | PTE_W) != 0)
-    goto fail;
-  
-  return kpt;
-
-fail:
-  kvmfree(kpt, 1);
-  return NULL;
-}
-
-// only free page table, not physical pages
-void
-kfreewalk(pagetable_t kpt)
-{
-  for (int i = 0; i < 512; i++) {
-    pte_t pte = kpt[i];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-      kpt[i] = 0;
-    } else if (pte & PTE_V) {
-      break;
-    }
-  }
-  kfree((void *) kpt);
-}
-
-void
-kvmfreeusr(pagetable_t kpt)
-{
-  pte_t pte;
-  for (int i = 0; i < PX(2, MAXUVA); i++) {
-    pte = kpt[i];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-      kpt[i] = 0;
-    }
-  }
-}
-
+// Make process page table pt the one this CPU runs on, loading it
+// into satp unless it is there already, and record it in
+// mycpu()->pagetable so uvmfree() won't free it underneath us. Frees
+// the table left behind if its owner gave it up meanwhile and no
+// other CPU is on it. Interrupts must be disabled.
 void
-kvmfree(pagetable_t kpt, int stack_free)
+kvmswitch(pagetable_t pt)
 {
-  if (stack_free) {
-    vmunmap(kpt, VKSTACK, 1, 1);
-    pte_t pte = kpt[PX(2, VKSTACK)];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-    }
+  struct cpu *c = mycpu(), *o;
+  pagetable_t old;
+  int dead;
+
+  acquire(&ptlock);
+  old = c->pagetable;
+  dead = c->ptfree;
+  c->pagetable = pt;
+  c->ptfree = 0;
+  for (o = cpus; dead && o < &cpus[NCPU]; o++)
+    if (o->pagetable == old)
+      dead = 0;
+  release(&ptlock);
+
+  if (r_satp() != MAKE_SATP(pt)) {
+    w_satp(MAKE_SATP(pt));
+    sfence_vma();
   }
-  kvmfreeusr(kpt);
-  kfree(kpt);
+  if (dead && old != pt)
+    kfree(old);
 }
 
 void vmprint(pagetable_t pagetable)
@@ -632,12 +745,16 @@ void vmprint(pagetable_t pagetable)
     {
       pagetable_t pt2 = (pagetable_t) PTE2PA(*pte); 
       printf("..%d: pte %p pa %p\n", pte - pagetable, *pte, pt2);
+      if (*pte & (PTE_R|PTE_W|PTE_X))
+        continue;
 
       for (pte_t *pte2 = (pte_t *) pt2; pte2 < pt2 + capacity; pte2++) {
         if (*pte2 & PTE_V)
         {
           pagetable_t pt3 = (pagetable_t) PTE2PA(*pte2);
           printf(".. ..%d: pte %p pa %p\n", pte2 - pt2, *pte2, pt3);
+          if (*pte2 & (PTE_R|PTE_W|PTE_X))
+            continue;
 
           for (pte_t *pte3 = (pte_t *) pt3; pte3 < pt3 + capacity; pte3++)
             if (*pte3 & PTE_V)
@@ -3,58 +3,76 @@
 #include "kernel/include/fcntl.h"
 #include "xv6-user/user.h"
 
+#define BUFSZ 1024
+
 static char path[512];
 
-void find(char *filename)
+// Search the directory open as fd, whose name is in path. Entries come
+// in batches from readdirplus(), and subdirectories are opened relative
+// to fd, so no path is resolved from the root again.
+void find(int fd, char *filename)
 {
-    int fd;
-    struct stat st;
-    if ((fd = open(path, O_RDONLY)) < 0) {
-        fprintf(2, "find: cannot open %s\n", path);
-        return;
-    }
-    if (fstat(fd, &st) < 0) {
-        fprintf(2, "find: cannot stat %s\n", path);
-        close(fd);
-        return;
-    }
-    if (st.type != T_DIR) {
-        close(fd);
+    int n, sub, len = strlen(path);
+    char *buf, *p;
+    struct direntplus *d;
+
+    if (len + 255 + 2 > sizeof(path)) {
+        fprintf(2, "find: path too long\n");
         return;
     }
-    if (strlen(path) + 255 + 2 > sizeof(path)) {
-        fprintf(2, "find: path too long\n");
-        close(fd);
+    if ((buf = malloc(BUFSZ)) == 0) {
+        fprintf(2, "find: out of memory\n");
         return;
     }
-    char *p = path + strlen(path) - 1;
-    if (*p != '/') {
-        *++p = '/';
+    p = path + len;
+    if (len == 0 || p[-1] != '/') {
+        *p++ = '/';
     }
-    p++;
-    while (readdir(fd, &st)) {
-        strcpy(p, st.name);
-        if (strcmp(p, ".") == 0 || strcmp(p, "..") == 0) {
-            continue;
+    while ((n = readdirplus(fd, (struct direntplus *)buf, BUFSZ)) > 0) {
+        for (int off = 0; off < n; off += d->d_reclen) {
+            d = (struct direntplus *)(buf + off);
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+            strcpy(p, d->d_name);
+            if (strcmp(p, filename) == 0) {
+                fprintf(1, "%s\n", path);
+            }
+            if (d->d_type != DT_DIR) {
+                continue;
+            }
+            if ((sub = openat(fd, d->d_name, O_RDONLY, 0)) < 0) {
+                fprintf(2, "find: cannot open %s\n", path);
+                continue;
+            }
+            find(sub, filename);
+            close(sub);
         }
-        if (strcmp(p, filename) == 0) {
-            fprintf(1, "%s\n", path);
-        }
-        find(filename);
     }
-    close(fd);
-    return;
+    path[len] = '\0';
+    free(buf);
 }
 
 
 int main(int argc, char *argv[])
 {
+    int fd;
+    struct stat st;
+
     if (argc < 3) {
         fprintf(2, "Usage: find DIR FILENAME\n");
         exit(0);
-    } else {
-        strcpy(path, argv[1]);
-        find(argv[2]);
     }
+    strcpy(path, argv[1]);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        fprintf(2, "find: cannot open %s\n", path);
+        exit(0);
+    }
+    if (fstat(fd, &st) < 0) {
+        fprintf(2, "find: cannot stat %s\n", path);
+    } else if (st.type == T_DIR) {
+        find(fd, argv[2]);
+    }
+    close(fd);
     exit(0);
 }
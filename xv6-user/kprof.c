@@ -0,0 +1,204 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/fcntl.h"
+#include "kernel/include/kprof.h"
+#include "xv6-user/user.h"
+
+//
+// Profile a command with the kernel's timer-driven sampler. Kernel
+// samples are symbolized against the kernel symbol table written by
+// the build (target/kernel.sym, copied to /kernel.sym on the fs
+// image); user samples are counted per pid. With -r, print one line
+// per sample instead: hart, pid, k or u, pc and kernel symbol.
+//
+// usage: kprof [-r] [-s SYMFILE] command [args...]
+//
+
+#define NTOP 20  // kernel symbols to list
+#define NPID 16  // user pids to tell apart
+
+struct sym {
+  uint64 addr;
+  char *name;
+  int hits;
+};
+
+struct sym *syms;
+int nsym;
+
+struct kprof_sample samples[64];
+
+static int
+hexval(char c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Read "address name" lines into syms[], sorted by address.
+static void
+loadsyms(char *path)
+{
+  struct stat st;
+  char *buf, *p, *end;
+  int fd, n, i, j, gap, h;
+  uint64 addr;
+  struct sym t;
+
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+    fprintf(2, "kprof: cannot read %s, kernel pcs stay raw\n", path);
+    if(fd >= 0)
+      close(fd);
+    return;
+  }
+  buf = malloc(st.size + 1);
+  for(n = 0; n < st.size && (i = read(fd, buf + n, st.size - n)) > 0; n += i)
+    ;
+  close(fd);
+  buf[n] = '\n';
+  end = buf + n;
+
+  for(p = buf, i = 0; p <= end; p++)
+    if(*p == '\n')
+      i++;
+  syms = malloc(i * sizeof(struct sym));
+  for(p = buf; p < end; p++){
+    for(addr = 0; (h = hexval(*p)) >= 0; p++)
+      addr = addr * 16 + h;
+    if(*p == ' '){
+      syms[nsym].addr = addr;
+      syms[nsym].name = ++p;
+      syms[nsym].hits = 0;
+      nsym++;
+    }
+    while(*p != '\n')
+      p++;
+    *p = 0;
+  }
+
+  // shell sort by address
+  for(gap = nsym / 2; gap > 0; gap /= 2){
+    for(i = gap; i < nsym; i++){
+      t = syms[i];
+      for(j = i; j >= gap && syms[j - gap].addr > t.addr; j -= gap)
+        syms[j] = syms[j - gap];
+      syms[j] = t;
+    }
+  }
+}
+
+// The symbol covering pc: the last one at or below it.
+static struct sym *
+lookup(uint64 pc)
+{
+  int lo = 0, hi = nsym - 1, mid;
+
+  if(nsym == 0 || pc < syms[0].addr)
+    return 0;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return &syms[lo];
+}
+
+int
+main(int argc, char *argv[])
+{
+  int raw = 0, pid, n, i, j, best;
+  int total = 0, kernel = 0, unknown = 0, idle = 0;
+  char *symfile = "/kernel.sym";
+  struct sym *s;
+  int upid[NPID], uhits[NPID], nu = 0;
+
+  for(argv++, argc--; argc > 0 && argv[0][0] == '-'; argv++, argc--){
+    if(strcmp(argv[0], "-r") == 0)
+      raw = 1;
+    else if(strcmp(argv[0], "-s") == 0 && argc > 1){
+      symfile = argv[1];
+      argv++;
+      argc--;
+    } else
+      break;
+  }
+  if(argc < 1){
+    fprintf(2, "usage: kprof [-r] [-s SYMFILE] command [args...]\n");
+    exit(1);
+  }
+  loadsyms(symfile);
+
+  if(kprof(KPROF_START, 0, 0) < 0){
+    fprintf(2, "kprof: cannot start the profiler\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    fprintf(2, "kprof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[0], argv);
+    fprintf(2, "kprof: exec %s failed\n", argv[0]);
+    exit(1);
+  }
+  wait(0);
+  kprof(KPROF_STOP, 0, 0);
+
+  while((n = kprof(KPROF_READ, samples, NELEM(samples))) > 0){
+    for(i = 0; i < n; i++){
+      total++;
+      if(samples[i].user){
+        for(j = 0; j < nu && upid[j] != samples[i].pid; j++)
+          ;
+        if(j == nu && nu < NPID){
+          upid[nu] = samples[i].pid;
+          uhits[nu++] = 0;
+        }
+        if(j < nu)
+          uhits[j]++;
+        if(raw)
+          printf("%d %d u %p\n", samples[i].hart, samples[i].pid, samples[i].pc);
+        continue;
+      }
+      kernel++;
+      if(samples[i].pid == 0)
+        idle++;
+      s = lookup(samples[i].pc);
+      if(s)
+        s->hits++;
+      else
+        unknown++;
+      if(raw)
+        printf("%d %d k %p %s\n", samples[i].hart, samples[i].pid,
+               samples[i].pc, s ? s->name : "?");
+    }
+  }
+  if(raw)
+    exit(0);
+
+  printf("kprof: %d samples, %d kernel (%d idle), %d user, %d dropped\n",
+         total, kernel, idle, total - kernel, kprof(KPROF_DROPPED, 0, 0));
+  for(i = 0; i < NTOP; i++){
+    best = -1;
+    for(j = 0; j < nsym; j++)
+      if(syms[j].hits > 0 && (best < 0 || syms[j].hits > syms[best].hits))
+        best = j;
+    if(best < 0)
+      break;
+    printf("%d\t%d%%\t%s\n", syms[best].hits, syms[best].hits * 100 / total,
+           syms[best].name);
+    syms[best].hits = 0;
+  }
+  if(unknown)
+    printf("%d\t%d%%\t?\n", unknown, unknown * 100 / total);
+  for(j = 0; j < nu; j++)
+    printf("%d\t%d%%\t[user pid %d]\n", uhits[j], uhits[j] * 100 / total, upid[j]);
+  exit(0);
+}
@@ -0,0 +1,77 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+//
+// List the most contended kernel locks, pooled by lock name. Times
+// are timebase ticks. With a command, clear the counters, run it and
+// report what happened meanwhile; -r clears them after reporting.
+// The kernel only keeps the statistics when built with lockstat=1.
+//
+// usage: lockstat [-r] [command [args...]]
+//
+
+#define NSTAT 48
+
+struct lockstat st[NSTAT];
+
+static void
+report(int reset)
+{
+  int n, i, j, best;
+  struct lockstat t;
+
+  if((n = lockstat(st, NSTAT, reset)) < 0){
+    fprintf(2, "lockstat: failed; is the kernel built with lockstat=1?\n");
+    exit(1);
+  }
+  // most contended first, ties broken by time spent waiting
+  for(i = 0; i < n; i++){
+    best = i;
+    for(j = i + 1; j < n; j++)
+      if(st[j].contended > st[best].contended ||
+         (st[j].contended == st[best].contended && st[j].waitticks > st[best].waitticks))
+        best = j;
+    t = st[i];
+    st[i] = st[best];
+    st[best] = t;
+  }
+  printf("lock\t\ttype\tacquires\tcontended\tspins\twait\thold\n");
+  for(i = 0; i < n; i++){
+    printf("%s\t%s%s\t%l\t%l\t%l\t%l\t%l\n", st[i].name,
+           strlen(st[i].name) < 8 ? "\t" : "",
+           st[i].type == LOCKSTAT_SLEEP ? "sleep" : "spin",
+           st[i].acquires, st[i].contended, st[i].spins,
+           st[i].waitticks, st[i].holdticks);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int reset = 0, pid;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    reset = 1;
+    argv++;
+    argc--;
+  }
+  if(argc < 2){
+    report(reset);
+    exit(0);
+  }
+
+  lockstat(0, 0, 1);
+  if((pid = fork()) < 0){
+    fprintf(2, "lockstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  report(reset);
+  exit(0);
+}
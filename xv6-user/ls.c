@@ -2,6 +2,8 @@
 #include "kernel/include/stat.h"
 #include "xv6-user/user.h"
 
+char buf[1024];
+
 char*
 fmtname(char *name)
 {
@@ -20,8 +22,9 @@ fmtname(char *name)
 void
 ls(char *path)
 {
-  int fd;
+  int fd, n;
   struct stat st;
+  struct direntplus *d;
   char *types[] = {
     [T_DIR]   "DIR ",
     [T_FILE]  "FILE",
@@ -39,8 +42,13 @@ ls(char *path)
   }
 
   if (st.type == T_DIR){
-    while(readdir(fd, &st) == 1){
-      printf("%s %s\t%d\n", fmtname(st.name), types[st.type], st.size);
+    // many entries, with their sizes, per system call.
+    while((n = readdirplus(fd, (struct direntplus *)buf, sizeof(buf))) > 0){
+      for(int off = 0; off < n; off += d->d_reclen){
+        d = (struct direntplus *)(buf + off);
+        printf("%s %s\t%d\n", fmtname(d->d_name),
+               types[d->d_type == DT_DIR ? T_DIR : T_FILE], d->d_size);
+      }
     }
   } else {
     printf("%s %s\t%l\n", fmtname(st.name), types[st.type], st.size);
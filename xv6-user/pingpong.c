@@ -0,0 +1,74 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+//
+// Context-switch latency benchmark: parent and child bounce one
+// byte back and forth over a pair of pipes ROUNDS times, so every
+// round trip costs two sleeps, two wakeups and two switches between
+// the processes. Reports the average round trip in microseconds.
+//
+// usage: pingpong [ROUNDS]
+//
+
+static uint64
+now_usec(void)
+{
+  struct timeval tv;
+  if(gettimeofday(&tv) < 0)
+    return 0;
+  return tv.sec * 1000000 + tv.usec;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2], pid, i, rounds = 10000;
+  char c = 'x';
+  uint64 t0, t1, usec;
+
+  if(argc > 1)
+    rounds = atoi(argv[1]);
+  if(rounds <= 0){
+    fprintf(2, "usage: pingpong [ROUNDS]\n");
+    exit(1);
+  }
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "pingpong: pipe failed\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pingpong: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1){
+      if(write(pong[1], &c, 1) != 1)
+        exit(1);
+    }
+    exit(0);
+  }
+
+  close(ping[0]);
+  close(pong[1]);
+  t0 = now_usec();
+  for(i = 0; i < rounds; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      fprintf(2, "pingpong: round %d failed\n", i);
+      exit(1);
+    }
+  }
+  t1 = now_usec();
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+
+  usec = (t1 - t0) * 10 / rounds;
+  printf("pingpong: %d round trips in %d us: %d.%d us each\n",
+         rounds, (int)(t1 - t0), (int)(usec / 10), (int)(usec % 10));
+  exit(0);
+}
@@ -0,0 +1,95 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/fcntl.h"
+#include "xv6-user/user.h"
+
+//
+// Pipe throughput benchmark: a child writes SIZE kilobytes into a
+// pipe in CHUNK-byte writes while the parent drains it, then the
+// parent reports the transfer rate. PIPESZ, if given, resizes the
+// pipe buffer with F_SETPIPE_SZ before the transfer starts.
+//
+// usage: pipebench [SIZE_KB] [CHUNK] [PIPESZ]
+//
+
+char buf[4096];
+
+static uint64
+now_usec(void)
+{
+  struct timeval tv;
+  if(gettimeofday(&tv) < 0)
+    return 0;
+  return tv.sec * 1000000 + tv.usec;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fds[2], pid, n;
+  int kb = 1024, chunk = sizeof(buf), pipesz = 0;
+  uint64 total, left, t0, t1, usec, kbps;
+
+  if(argc > 1)
+    kb = atoi(argv[1]);
+  if(argc > 2)
+    chunk = atoi(argv[2]);
+  if(argc > 3)
+    pipesz = atoi(argv[3]);
+  if(kb <= 0 || chunk <= 0 || chunk > sizeof(buf) || pipesz < 0){
+    fprintf(2, "usage: pipebench [SIZE_KB] [CHUNK<=%d] [PIPESZ]\n", sizeof(buf));
+    exit(1);
+  }
+  total = (uint64)kb * 1024;
+  memset(buf, 'x', sizeof(buf));
+
+  if(pipe(fds) < 0){
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+  if(pipesz > 0 && fcntl(fds[1], F_SETPIPE_SZ, pipesz) < 0){
+    fprintf(2, "pipebench: cannot resize pipe to %d\n", pipesz);
+    exit(1);
+  }
+  pipesz = fcntl(fds[1], F_GETPIPE_SZ, 0);
+
+  t0 = now_usec();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(left = total; left > 0; left -= n){
+      n = left < chunk ? left : chunk;
+      if(write(fds[1], buf, n) != n){
+        fprintf(2, "pipebench: write failed\n");
+        exit(1);
+      }
+    }
+    close(fds[1]);
+    exit(0);
+  }
+
+  close(fds[1]);
+  left = total;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    left -= n;
+  close(fds[0]);
+  wait(0);
+  t1 = now_usec();
+
+  if(left != 0){
+    fprintf(2, "pipebench: short transfer, %d bytes missing\n", (int)left);
+    exit(1);
+  }
+  usec = t1 - t0;
+  if(usec == 0)
+    usec = 1;
+  kbps = total * 1000000 / usec / 1024;
+  printf("pipebench: %d KB in %d us, chunk %d, pipe %d: %d.%d MB/s\n",
+         kb, (int)usec, chunk, pipesz,
+         (int)(kbps / 1024), (int)((kbps % 1024) * 10 / 1024));
+  exit(0);
+}
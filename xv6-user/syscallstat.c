@@ -0,0 +1,72 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+//
+// Print per-syscall call counts and latency histograms. Latencies
+// are timebase ticks, as the kernel measures them with r_time().
+// With a command, clear the counters, run it and report what it did
+// (the shell and this tool's own calls add a few entries). Otherwise
+// report everything since boot, or since the last -r.
+//
+// usage: syscallstat [-r] [command [args...]]
+//
+
+#define NSTAT 80
+
+struct sysstat st[NSTAT];
+
+static void
+report(int reset)
+{
+  int n, i, b, lo;
+
+  if((n = syscallstat(st, NSTAT, reset)) < 0){
+    fprintf(2, "syscallstat: failed\n");
+    exit(1);
+  }
+  printf("%s\t%s\t%s\t%s\n", "syscall", "calls", "avg", "max");
+  for(i = 0; i < n; i++){
+    printf("%s\t%l\t%l\t%l\n", st[i].name, st[i].count,
+           st[i].ticks / st[i].count, st[i].max);
+    for(b = 0; b < SYSSTAT_NBUCKET; b++){
+      if(st[i].hist[b] == 0)
+        continue;
+      lo = b == 0 ? 0 : 1 << (b - 1);
+      if(b == SYSSTAT_NBUCKET - 1)
+        printf("\t>= %d\t%l\n", lo, st[i].hist[b]);
+      else
+        printf("\t%d-%d\t%l\n", lo, b == 0 ? 0 : (1 << b) - 1, st[i].hist[b]);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int reset = 0, pid;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    reset = 1;
+    argv++;
+    argc--;
+  }
+  if(argc < 2){
+    report(reset);
+    exit(0);
+  }
+
+  syscallstat(0, 0, 1);
+  if((pid = fork()) < 0){
+    fprintf(2, "syscallstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "syscallstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  report(reset);
+  exit(0);
+}
@@ -150,3 +150,115 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Mutex after Drepper, "Futexes Are Tricky": state is 0 when free,
+// 1 when locked, 2 when locked and somebody may be asleep on it.
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+}
+
+// Condition variable: waiters sleep on a sequence number that every
+// signal bumps, so a signal between unlock and sleep isn't lost.
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex(&c->seq, FUTEX_WAKE, 0x7fffffff);
+}
+
+#define THREAD_STACK 4096
+
+// clone() starts a thread here, on its new stack.
+static void
+thread_start(int zero, struct thread *t)
+{
+  t->ret = t->fn(t->arg);
+  __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+  futex(&t->done, FUTEX_WAKE, 0x7fffffff);
+  exit(0);
+}
+
+// Run fn(arg) in a new thread sharing memory and open files with
+// the caller. Returns 0, or -1 if the thread couldn't be created.
+int
+thread_create(struct thread *t, int (*fn)(void *), void *arg)
+{
+  uint64 *sp;
+
+  if((t->stack = malloc(THREAD_STACK)) == 0)
+    return -1;
+  t->fn = fn;
+  t->arg = arg;
+  t->done = 0;
+  // clone() takes the entry point and its argument from the top of
+  // the stack; keep sp 16-byte aligned for the calling convention.
+  sp = (uint64 *)(((uint64)t->stack + THREAD_STACK) & ~15L) - 2;
+  sp[0] = (uint64)thread_start;
+  sp[1] = (uint64)t;
+  if((t->pid = clone(CLONE_VM|CLONE_FILES, sp)) < 0){
+    free(t->stack);
+    return -1;
+  }
+  return 0;
+}
+
+// Wait for t to finish and return fn's result. Must be called by the
+// thread that created t, which also reaps it and frees its stack.
+int
+thread_join(struct thread *t)
+{
+  while(__atomic_load_n(&t->done, __ATOMIC_ACQUIRE) == 0)
+    futex(&t->done, FUTEX_WAIT, 0);
+  waitpid(t->pid, 0, 0);
+  free(t->stack);
+  return t->ret;
+}
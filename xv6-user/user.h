@@ -1,10 +1,22 @@
 #include "kernel/include/types.h"
 #include "kernel/include/stat.h"
 #include "kernel/include/fcntl.h"
+#include "kernel/include/uio.h"
+#include "kernel/include/ioring.h"
+#include "kernel/include/sched.h"
+#include "kernel/include/sysstat.h"
+#include "kernel/include/lockstat.h"
+#include "kernel/include/dirent64.h"
 
 struct stat;
 struct rtcdate;
 struct sysinfo;
+struct kprof_sample;
+
+struct timeval {
+  uint64 sec;   // seconds
+  uint64 usec;  // microseconds
+};
 
 // system calls
 int fork(void);
@@ -34,6 +46,33 @@ int trace(int mask);
 int sysinfo(struct sysinfo *);
 int rename(char *old, char *new);
 int shutdown(void);
+int gettimeofday(struct timeval *);
+int fcntl(int fd, int cmd, int arg);
+int splice(int fd_in, uint *off_in, int fd_out, uint *off_out, int len, int flags);
+int tee(int fd_in, int fd_out, int len, int flags);
+int sendfile(int out_fd, int in_fd, uint *offset, int count);
+int readv(int fd, struct iovec *iov, int iovcnt);
+int writev(int fd, struct iovec *iov, int iovcnt);
+int pread(int fd, void *buf, int count, uint offset);
+int pwrite(int fd, void *buf, int count, uint offset);
+int preadv(int fd, struct iovec *iov, int iovcnt, uint offset);
+int pwritev(int fd, struct iovec *iov, int iovcnt, uint offset);
+int fsync(int fd);
+int ioring_enter(struct io_ring *ring);
+// stack points at {fn, arg}; the child starts at fn(0, arg) on that stack.
+int clone(int flags, void *stack);
+int futex(volatile int *uaddr, int op, int val);
+int waitpid(int pid, int *status, int options);
+int syscallstat(struct sysstat *st, int n, int reset);
+int kprof(int op, struct kprof_sample *buf, int n);
+int lockstat(struct lockstat *st, int n, int reset);
+int getdents(int fd, struct linux_dirent64 *buf, int len);
+int readdirplus(int fd, struct direntplus *buf, int len);
+int openat(int dirfd, const char *path, int flags, int mode);
+int mkdirat(int dirfd, const char *path, int mode);
+int unlinkat(int dirfd, const char *path, int flags);
+void *mmap(void *addr, int len, int prot, int flags, int fd, int off);
+int munmap(void *addr, int len);
 
 // ulib.c
 int stat(const char *, struct stat *);
@@ -52,3 +91,30 @@ void free(void *);
 int atoi(const char *);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+
+struct mutex {
+  volatile int state;
+};
+
+struct cond {
+  volatile int seq;
+};
+
+struct thread {
+  int pid;
+  volatile int done;
+  int (*fn)(void *);
+  void *arg;
+  int ret;
+  void *stack;
+};
+
+void mutex_init(struct mutex *);
+void mutex_lock(struct mutex *);
+void mutex_unlock(struct mutex *);
+void cond_init(struct cond *);
+void cond_wait(struct cond *, struct mutex *);
+void cond_signal(struct cond *);
+void cond_broadcast(struct cond *);
+int thread_create(struct thread *, int (*)(void *), void *);
+int thread_join(struct thread *);
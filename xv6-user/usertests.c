@@ -4,8 +4,10 @@
 #include "xv6-user/user.h"
 #include "kernel/include/fcntl.h"
 #include "kernel/include/syscall.h"
+#include "kernel/include/kprof.h"
 #include "kernel/include/memlayout.h"
 #include "kernel/include/riscv.h"
+#include "kernel/include/sysinfo.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -736,6 +738,1098 @@ pipe1(char *s)
   }
 }
 
+// grow a pipe with data in flight, fill it without a reader,
+// and make sure nothing is lost or reordered.
+void
+pipesize(char *s)
+{
+  int fds[2], i, n, sz, total;
+  enum { BIG=16384 };
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 100; i++)
+    buf[i] = i;
+  if(write(fds[1], buf, 100) != 100){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if((sz = fcntl(fds[1], F_SETPIPE_SZ, BIG)) != BIG || fcntl(fds[0], F_GETPIPE_SZ, 0) != BIG){
+    printf("%s: F_SETPIPE_SZ returned %d\n", s, sz);
+    exit(1);
+  }
+  // the rest of the ring must accept a write without a reader.
+  for(total = 100; total < BIG; total += n){
+    n = BIG - total;
+    if(n > sizeof(buf))
+      n = sizeof(buf);
+    for(i = 0; i < n; i++)
+      buf[i] = total + i;
+    if(write(fds[1], buf, n) != n){
+      printf("%s: write to grown pipe failed\n", s);
+      exit(1);
+    }
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 10) >= 0 || fcntl(fds[1], F_GETPIPE_SZ, 0) != BIG){
+    printf("%s: shrank below buffered data\n", s);
+    exit(1);
+  }
+  for(total = 0; total < BIG; total += n){
+    if((n = read(fds[0], buf, 1000)) <= 0){
+      printf("%s: read failed at %d\n", s, total);
+      exit(1);
+    }
+    for(i = 0; i < n; i++){
+      if((buf[i] & 0xff) != ((total + i) & 0xff)){
+        printf("%s: wrong byte at %d\n", s, total + i);
+        exit(1);
+      }
+    }
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 0) <= 0){
+    printf("%s: cannot shrink empty pipe\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// move a file through pipes with splice(), tee() and sendfile()
+// and check that every copy arrives intact.
+void
+splicetest(char *s)
+{
+  int fd, fd2, p1[2], p2[2], i, n, total;
+  uint off;
+  enum { SZ=3000 };
+
+  remove("splicein");
+  remove("spliceout");
+  fd = open("splicein", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create splicein failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i++)
+    buf[i] = i * 7;
+  if(write(fd, buf, SZ) != SZ){
+    printf("%s: write splicein failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("splicein", O_RDONLY);
+  fd2 = open("spliceout", O_CREATE|O_RDWR);
+  if(fd < 0 || fd2 < 0 || pipe(p1) != 0 || pipe(p2) != 0){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  // an explicit offset leaves the file position alone.
+  off = 1000;
+  if(splice(fd, &off, p1[1], 0, SZ, 0) != SZ - 1000 || off != SZ){
+    printf("%s: splice with offset moved wrong amount\n", s);
+    exit(1);
+  }
+  if(splice(fd, 0, p1[1], 0, 1000, 0) != 1000){
+    printf("%s: splice from file failed\n", s);
+    exit(1);
+  }
+  if(tee(p1[0], p2[1], SZ, 0) != SZ){
+    printf("%s: tee failed\n", s);
+    exit(1);
+  }
+  for(total = 0; total < SZ; total += n){
+    if((n = splice(p1[0], 0, fd2, 0, SZ - total, 0)) <= 0){
+      printf("%s: splice to file failed\n", s);
+      exit(1);
+    }
+  }
+  for(total = 0; total < SZ; total += n){
+    if((n = read(p2[0], buf + total, SZ - total)) <= 0){
+      printf("%s: read tee copy failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < SZ; i++){
+    if((buf[i] & 0xff) != (((i + 1000) % SZ * 7) & 0xff)){
+      printf("%s: tee copy wrong at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  off = 0;
+  if(sendfile(p2[1], fd2, &off, SZ) != SZ || off != SZ){
+    printf("%s: sendfile failed\n", s);
+    exit(1);
+  }
+  for(total = 0; total < SZ; total += n){
+    if((n = read(p2[0], buf + total, SZ - total)) <= 0){
+      printf("%s: read sendfile data failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < SZ; i++){
+    if((buf[i] & 0xff) != (((i + 1000) % SZ * 7) & 0xff)){
+      printf("%s: spliced file wrong at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(tee(p1[0], p1[1], 1, 0) >= 0 || splice(p1[0], 0, p1[1], 0, 1, 0) >= 0 ||
+     splice(fd, 0, fd2, 0, 1, 0) >= 0){
+    printf("%s: bad splice accepted\n", s);
+    exit(1);
+  }
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+  close(p2[1]);
+  close(fd);
+  close(fd2);
+  remove("splicein");
+  remove("spliceout");
+}
+
+// readv/writev move several buffers in one call; the positional
+// variants must leave the file offset untouched.
+void
+vectorio(char *s)
+{
+  int fd;
+  char a[10], b[20], c[30];
+  struct iovec iov[3];
+
+  remove("vectorio");
+  fd = open("vectorio", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  memset(a, 'a', sizeof(a));
+  memset(b, 'b', sizeof(b));
+  memset(c, 'c', sizeof(c));
+  iov[0].iov_base = a; iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b; iov[1].iov_len = sizeof(b);
+  iov[2].iov_base = c; iov[2].iov_len = sizeof(c);
+  if(writev(fd, iov, 3) != 60){
+    printf("%s: writev failed\n", s);
+    exit(1);
+  }
+  // overwrite the middle without moving the offset, which is at 60.
+  if(pwrite(fd, "XYZ", 3, 15) != 3 || write(fd, "!", 1) != 1){
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  memset(buf, 0, 100);
+  if(pread(fd, buf, 100, 0) != 61 || buf[14] != 'b' || buf[15] != 'X' ||
+     buf[17] != 'Z' || buf[30] != 'c' || buf[60] != '!'){
+    printf("%s: pread saw wrong data\n", s);
+    exit(1);
+  }
+  // a vector that starts mid-file and stops at the end of it.
+  iov[0].iov_base = buf; iov[0].iov_len = 5;
+  iov[1].iov_base = buf + 5; iov[1].iov_len = 50;
+  if(preadv(fd, iov, 2, 25) != 36 || buf[0] != 'b' || buf[5] != 'c' || buf[35] != '!'){
+    printf("%s: preadv failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("vectorio", O_RDONLY);
+  iov[0].iov_base = a; iov[0].iov_len = sizeof(a);
+  iov[1].iov_base = b; iov[1].iov_len = sizeof(b);
+  if(readv(fd, iov, 2) != 30 || a[0] != 'a' || b[5] != 'X' || b[9] != 'b'){
+    printf("%s: readv failed\n", s);
+    exit(1);
+  }
+  if(read(fd, c, 1) != 1 || c[0] != 'c'){
+    printf("%s: readv did not advance the offset\n", s);
+    exit(1);
+  }
+  if(pwritev(fd, iov, 1, 0) >= 0 || readv(fd, iov, IOV_MAX + 1) >= 0){
+    printf("%s: bad vector accepted\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("vectorio");
+}
+
+static struct io_ring ring;
+
+static void
+ioring_queue(int op, int fd, void *addr, int len, int off, int flags)
+{
+  struct io_sqe *sqe = &ring.sq[ring.sq_tail % IORING_ENTRIES];
+
+  sqe->opcode = op;
+  sqe->flags = flags;
+  sqe->fd = fd;
+  sqe->addr = (uint64)addr;
+  sqe->len = len;
+  sqe->off = off;
+  sqe->user_data = ring.sq_tail;
+  ring.sq_tail++;
+}
+
+// run open, writes, fsync, a positional read and close through the
+// syscall ring, a batch per trap, and check every completion.
+void
+ioring(char *s)
+{
+  int fd, i, n;
+  char data[16], back[16 * 8];
+  struct io_cqe *cqe;
+
+  remove("ioringf");
+  ioring_queue(IORING_OP_OPEN, 0, "ioringf", O_CREATE|O_RDWR, 0, 0);
+  if(ioring_enter(&ring) != 1 || ring.cq_tail != 1 || (fd = ring.cq[0].res) < 0){
+    printf("%s: ring open failed\n", s);
+    exit(1);
+  }
+  ring.cq_head = ring.cq_tail;
+
+  // buffers are read when the ring runs, so each write gets its own.
+  for(i = 0; i < 8; i++){
+    memset(back + i * 16, 'a' + i, 16);
+    ioring_queue(IORING_OP_WRITE, fd, back + i * 16, 16, 0, 0);
+  }
+  ioring_queue(IORING_OP_FSYNC, fd, 0, 0, 0, 0);
+  ioring_queue(IORING_OP_READ, fd, data, 16, 3 * 16, IOSQE_FIXED_OFF);
+  ioring_queue(IORING_OP_CLOSE, fd, 0, 0, 0, 0);
+  if((n = ioring_enter(&ring)) != 11 || ring.sq_head != ring.sq_tail){
+    printf("%s: ring ran %d of 11\n", s, n);
+    exit(1);
+  }
+  for(; ring.cq_head != ring.cq_tail; ring.cq_head++){
+    cqe = &ring.cq[ring.cq_head % IORING_ENTRIES];
+    i = cqe->user_data - 1;
+    if(cqe->res != (i < 8 ? 16 : i == 9 ? 16 : 0)){
+      printf("%s: op %d returned %d\n", s, i, cqe->res);
+      exit(1);
+    }
+  }
+  if(data[0] != 'd' || data[15] != 'd'){
+    printf("%s: positional read got wrong data\n", s);
+    exit(1);
+  }
+  fd = open("ioringf", O_RDONLY);
+  if(fd < 0 || read(fd, back, sizeof(back)) != sizeof(back) || back[0] != 'a' || back[127] != 'h'){
+    printf("%s: file contents wrong\n", s);
+    exit(1);
+  }
+  close(fd);
+  remove("ioringf");
+
+  // the root directory has no entry of its own to write back.
+  fd = open("/", O_RDONLY);
+  if(fd < 0 || fsync(fd) != 0){
+    printf("%s: fsync of / failed\n", s);
+    exit(1);
+  }
+  close(fd);
+}
+
+volatile int threadval;
+int threadfd;
+
+static void
+threadmain(int zero, void *arg)
+{
+  threadval = *(int *)arg;
+  threadfd = open("threadf", O_CREATE|O_RDWR);
+  exit(0);
+}
+
+// a CLONE_VM|CLONE_FILES child must see and change the parent's
+// memory, and a file it opens must show up in the parent's table.
+void
+threadshare(char *s)
+{
+  uint64 *stack;
+  int pid, val = 42, xstatus;
+
+  stack = malloc(4096);
+  if(stack == 0){
+    printf("%s: malloc failed\n", s);
+    exit(1);
+  }
+  threadval = 0;
+  threadfd = -1;
+  stack[510] = (uint64)threadmain;
+  stack[511] = (uint64)&val;
+  pid = clone(CLONE_VM|CLONE_FILES, &stack[510]);
+  if(pid < 0){
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: thread failed\n", s);
+    exit(1);
+  }
+  if(threadval != 42){
+    printf("%s: thread's store not visible\n", s);
+    exit(1);
+  }
+  if(threadfd < 0 || write(threadfd, "x", 1) != 1){
+    printf("%s: thread's fd %d not shared\n", s, threadfd);
+    exit(1);
+  }
+  close(threadfd);
+  remove("threadf");
+  free(stack);
+}
+
+struct mutex futexmu;
+struct cond futexcv;
+int futexcount, futexturn;
+
+static int
+futexworker(void *arg)
+{
+  int me = (int)(uint64)arg;
+
+  for(int i = 0; i < 500; i++){
+    mutex_lock(&futexmu);
+    futexcount++;
+    mutex_unlock(&futexmu);
+  }
+  // then take turns in order, handing over through the condition.
+  mutex_lock(&futexmu);
+  while(futexturn != me)
+    cond_wait(&futexcv, &futexmu);
+  futexturn++;
+  cond_broadcast(&futexcv);
+  mutex_unlock(&futexmu);
+  return me * 10;
+}
+
+// threads built on futex: a contended mutex, a condition variable
+// and joins must neither lose updates nor wake the wrong waiter.
+void
+futextest(char *s)
+{
+  enum { N=4 };
+  struct thread t[N];
+  int x = 0;
+
+  if(futex(&x, FUTEX_WAIT, 1) >= 0 || futex(&x, FUTEX_WAKE, 1) != 0){
+    printf("%s: futex on an idle word misbehaved\n", s);
+    exit(1);
+  }
+  mutex_init(&futexmu);
+  cond_init(&futexcv);
+  futexcount = 0;
+  futexturn = 0;
+  for(int i = 0; i < N; i++){
+    if(thread_create(&t[i], futexworker, (void *)(uint64)i) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(int i = N - 1; i >= 0; i--){
+    if(thread_join(&t[i]) != i * 10){
+      printf("%s: thread %d returned the wrong value\n", s, i);
+      exit(1);
+    }
+  }
+  if(futexcount != N * 500 || futexturn != N){
+    printf("%s: count %d turn %d\n", s, futexcount, futexturn);
+    exit(1);
+  }
+}
+
+struct sysstat statbuf[80];
+
+// find syscall num in what syscallstat() returned; count 0 if absent.
+static uint64
+statcount(int n, int num, uint64 *histsum)
+{
+  for(int i = 0; i < n; i++){
+    if(statbuf[i].num != num)
+      continue;
+    *histsum = 0;
+    for(int b = 0; b < SYSSTAT_NBUCKET; b++)
+      *histsum += statbuf[i].hist[b];
+    return statbuf[i].count;
+  }
+  *histsum = 0;
+  return 0;
+}
+
+// per-syscall counters must see every call, and the latency
+// histogram must account for each of them.
+void
+syscallstattest(char *s)
+{
+  int n;
+  uint64 before, after, hist;
+
+  if((n = syscallstat(statbuf, NELEM(statbuf), 0)) < 0){
+    printf("%s: syscallstat failed\n", s);
+    exit(1);
+  }
+  before = statcount(n, SYS_getpid, &hist);
+  for(int i = 0; i < 100; i++)
+    getpid();
+  n = syscallstat(statbuf, NELEM(statbuf), 0);
+  after = statcount(n, SYS_getpid, &hist);
+  if(after < before + 100){
+    printf("%s: getpid count went from %d to %d\n", s, (int)before, (int)after);
+    exit(1);
+  }
+  if(hist != after){
+    printf("%s: histogram holds %d of %d calls\n", s, (int)hist, (int)after);
+    exit(1);
+  }
+  for(int i = 0; i < n; i++){
+    if(statbuf[i].num == SYS_getpid && strcmp(statbuf[i].name, "getpid") != 0){
+      printf("%s: getpid reported as %s\n", s, statbuf[i].name);
+      exit(1);
+    }
+  }
+}
+
+struct kprof_sample kprofbuf[64];
+
+// busy-wait in user mode for about ms milliseconds.
+static void
+spinms(int ms)
+{
+  struct timeval tv;
+  uint64 end;
+
+  gettimeofday(&tv);
+  end = tv.sec * 1000000 + tv.usec + ms * 1000;
+  do {
+    for(volatile int i = 0; i < 100000; i++)
+      ;
+    gettimeofday(&tv);
+  } while(tv.sec * 1000000 + tv.usec < end);
+}
+
+// the sampler must catch a process spinning in user space, and stop
+// recording once stopped.
+void
+kproftest(char *s)
+{
+  int n, mine = 0, total = 0;
+
+  if(kprof(KPROF_START, 0, 0) < 0){
+    printf("%s: kprof start failed\n", s);
+    exit(1);
+  }
+  spinms(2000);
+  kprof(KPROF_STOP, 0, 0);
+  while((n = kprof(KPROF_READ, kprofbuf, NELEM(kprofbuf))) > 0){
+    for(int i = 0; i < n; i++){
+      if(kprofbuf[i].user && kprofbuf[i].pid == getpid())
+        mine++;
+    }
+    total += n;
+  }
+  if(n < 0 || mine == 0){
+    printf("%s: %d samples, %d of this process in user mode\n", s, total, mine);
+    exit(1);
+  }
+  spinms(500);
+  if(kprof(KPROF_READ, kprofbuf, NELEM(kprofbuf)) != 0){
+    printf("%s: samples recorded after stop\n", s);
+    exit(1);
+  }
+}
+
+struct lockstat lockbuf[48];
+
+// lock statistics must count acquisitions of busy kernel locks,
+// and a reset must clear them.
+void
+lockstattest(char *s)
+{
+  int n, found = 0;
+
+  if(lockstat(0, 0, 1) < 0)
+    return;  // kernel built without lockstat=1
+  sleep(1);  // sleep() and the scheduler take proc locks
+  if((n = lockstat(lockbuf, NELEM(lockbuf), 0)) <= 0){
+    printf("%s: lockstat returned %d\n", s, n);
+    exit(1);
+  }
+  for(int i = 0; i < n; i++){
+    if(lockbuf[i].acquires == 0 || lockbuf[i].contended > lockbuf[i].acquires){
+      printf("%s: %s: %d acquires, %d contended\n", s, lockbuf[i].name,
+             (int)lockbuf[i].acquires, (int)lockbuf[i].contended);
+      exit(1);
+    }
+    if(lockbuf[i].type == LOCKSTAT_SPIN && strcmp(lockbuf[i].name, "proc") == 0)
+      found = 1;
+  }
+  if(!found){
+    printf("%s: no proc lock acquisitions\n", s);
+    exit(1);
+  }
+}
+
+// cached lookups must follow creates, renames and removes,
+// including names that differ only past the first few bytes.
+void
+dcachetest(char *s)
+{
+  int fd;
+
+  if(mkdir("dcd0") < 0 || mkdir("dcd0/dcd1") < 0 || mkdir("dcd0/dcd1/dcd2") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if((fd = open("dcd0/dcd1/dcd2/name-a", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(int i = 0; i < 10; i++){
+    if((fd = open("dcd0/dcd1/dcd2/name-a", O_RDONLY)) < 0){
+      printf("%s: open %d failed\n", s, i);
+      exit(1);
+    }
+    close(fd);
+    if(open("dcd0/dcd1/dcd2/name-b", O_RDONLY) >= 0){
+      printf("%s: opened a file never created\n", s);
+      exit(1);
+    }
+  }
+  if(rename("dcd0/dcd1/dcd2/name-a", "dcd0/dcd1/name-b") < 0){
+    printf("%s: rename failed\n", s);
+    exit(1);
+  }
+  if(open("dcd0/dcd1/dcd2/name-a", O_RDONLY) >= 0){
+    printf("%s: old name still opens after rename\n", s);
+    exit(1);
+  }
+  if((fd = open("dcd0/dcd1/name-b", O_RDONLY)) < 0){
+    printf("%s: new name does not open after rename\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(remove("dcd0/dcd1/name-b") < 0){
+    printf("%s: remove failed\n", s);
+    exit(1);
+  }
+  if(open("dcd0/dcd1/name-b", O_RDONLY) >= 0){
+    printf("%s: removed file still opens\n", s);
+    exit(1);
+  }
+  remove("dcd0/dcd1/dcd2");
+  remove("dcd0/dcd1");
+  remove("dcd0");
+}
+
+// a name that failed to look up must appear as soon as it is created,
+// as a file or as a directory, and vanish again once removed.
+void
+negdenttest(char *s)
+{
+  int fd;
+
+  remove("negfile");
+  remove("negdir");
+  for(int i = 0; i < 10; i++){
+    if(open("negfile", O_RDONLY) >= 0 || open("negdir/x", O_RDONLY) >= 0){
+      printf("%s: opened a missing file\n", s);
+      exit(1);
+    }
+  }
+  if((fd = open("negfile", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("negfile", O_RDONLY)) < 0){
+    printf("%s: created file does not open\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(mkdir("negdir") < 0 || (fd = open("negdir/x", O_CREATE|O_RDWR)) < 0){
+    printf("%s: mkdir or create in it failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("negdir/x", O_RDONLY)) < 0){
+    printf("%s: negdir/x does not open\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(remove("negfile") < 0 || remove("negdir/x") < 0 || remove("negdir") < 0){
+    printf("%s: remove failed\n", s);
+    exit(1);
+  }
+  if(open("negfile", O_RDONLY) >= 0 || open("negdir", O_RDONLY) >= 0){
+    printf("%s: removed file still opens\n", s);
+    exit(1);
+  }
+}
+
+// holding more files open than the entry cache used to have slots
+// for must neither panic nor fail.
+void
+ecachetest(char *s)
+{
+  enum { N = 240 };
+  static int fds[N];
+  char name[16];
+
+  if(mkdir("ecdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  strcpy(name, "ecdir/f000");
+  for(int i = 0; i < N; i++){
+    name[7] = '0' + i / 100;
+    name[8] = '0' + i / 10 % 10;
+    name[9] = '0' + i % 10;
+    if((fds[i] = open(name, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < N; i++){
+    name[7] = '0' + i / 100;
+    name[8] = '0' + i / 10 % 10;
+    name[9] = '0' + i % 10;
+    close(fds[i]);
+    if(remove(name) < 0){
+      printf("%s: remove %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(remove("ecdir") < 0){
+    printf("%s: remove ecdir failed\n", s);
+    exit(1);
+  }
+}
+
+// lookups in a directory big enough to be indexed must see
+// creates and removes made after the index was built.
+void
+dirindextest(char *s)
+{
+  enum { N = 100 };
+  char name[32];
+  int fd;
+
+  if(mkdir("dixdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  strcpy(name, "dixdir/a-rather-long-name-00");
+  for(int i = 0; i < N; i++){
+    name[26] = '0' + i / 10;
+    name[27] = '0' + i % 10;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(int i = 0; i < N; i += 2){
+    name[26] = '0' + i / 10;
+    name[27] = '0' + i % 10;
+    if(remove(name) < 0){
+      printf("%s: remove %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(int i = 0; i < N; i++){
+    name[26] = '0' + i / 10;
+    name[27] = '0' + i % 10;
+    fd = open(name, O_RDONLY);
+    if((fd >= 0) != (i % 2 == 1)){
+      printf("%s: %s %s\n", s, name, fd >= 0 ? "still opens" : "does not open");
+      exit(1);
+    }
+    if(fd >= 0){
+      close(fd);
+      remove(name);
+    }
+  }
+  if(remove("dixdir") < 0){
+    printf("%s: remove dixdir failed\n", s);
+    exit(1);
+  }
+}
+
+// getdents must list every entry of a directory exactly once when
+// read in small chunks, report the end with 0, and refuse a buffer
+// too small for one record.
+void
+getdentstest(char *s)
+{
+  enum { N = 40 };
+  static char dbuf[96];
+  char name[16], seen[N];
+  int fd, n, calls = 0;
+
+  if(mkdir("gddir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  strcpy(name, "gddir/e00");
+  for(int i = 0; i < N; i++){
+    name[7] = '0' + i / 10;
+    name[8] = '0' + i % 10;
+    if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  if((fd = open("gddir", O_RDONLY)) < 0){
+    printf("%s: open gddir failed\n", s);
+    exit(1);
+  }
+  if(getdents(fd, (struct linux_dirent64 *)dbuf, 8) != -1){
+    printf("%s: 8-byte buffer accepted\n", s);
+    exit(1);
+  }
+  memset(seen, 0, sizeof(seen));
+  while((n = getdents(fd, (struct linux_dirent64 *)dbuf, sizeof(dbuf))) > 0){
+    calls++;
+    for(int off = 0; off < n; ){
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(dbuf + off);
+      char *p = d->d_name;
+      if(p[0] == 'e' && p[3] == 0){
+        int i = (p[1] - '0') * 10 + (p[2] - '0');
+        if(i < 0 || i >= N || seen[i]++ || d->d_type != DT_REG){
+          printf("%s: bad or repeated entry %s\n", s, p);
+          exit(1);
+        }
+      }
+      off += d->d_reclen;
+    }
+  }
+  close(fd);
+  if(n < 0 || calls < 2){
+    printf("%s: getdents returned %d after %d calls\n", s, n, calls);
+    exit(1);
+  }
+  for(int i = 0; i < N; i++){
+    if(!seen[i]){
+      printf("%s: entry %d missing\n", s, i);
+      exit(1);
+    }
+    name[7] = '0' + i / 10;
+    name[8] = '0' + i % 10;
+    remove(name);
+  }
+  remove("gddir");
+}
+
+// readdirplus must report type and size with each name, and openat
+// must resolve relative paths from its directory fd, not the cwd.
+void
+readdirplustest(char *s)
+{
+  static char dbuf[512];
+  int dfd, fd, n, found = 0;
+
+  if(mkdir("rdpdir") < 0 || mkdir("rdpdir/sub") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if((dfd = open("rdpdir", O_RDONLY)) < 0){
+    printf("%s: open rdpdir failed\n", s);
+    exit(1);
+  }
+  if((fd = openat(dfd, "sub/f", O_CREATE|O_RDWR, 0)) < 0){
+    printf("%s: openat create failed\n", s);
+    exit(1);
+  }
+  if(write(fd, "hello", 5) != 5){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(open("sub/f", O_RDONLY) >= 0){
+    printf("%s: openat created relative to the cwd\n", s);
+    exit(1);
+  }
+  if((fd = openat(dfd, "sub", O_RDONLY, 0)) < 0){
+    printf("%s: openat sub failed\n", s);
+    exit(1);
+  }
+  if(openat(fd, "f", O_RDONLY, 0) < 0 || openat(AT_FDCWD, "rdpdir/sub/f", O_RDONLY, 0) < 0){
+    printf("%s: openat f failed\n", s);
+    exit(1);
+  }
+  while((n = readdirplus(fd, (struct direntplus *)dbuf, sizeof(dbuf))) > 0){
+    for(int off = 0; off < n; ){
+      struct direntplus *d = (struct direntplus *)(dbuf + off);
+      if(strcmp(d->d_name, "f") == 0){
+        if(d->d_type != DT_REG || d->d_size != 5 || d->d_clus == 0){
+          printf("%s: f: type %d size %d\n", s, d->d_type, d->d_size);
+          exit(1);
+        }
+        found++;
+      }
+      off += d->d_reclen;
+    }
+  }
+  if(n < 0 || found != 1){
+    printf("%s: readdirplus returned %d, found f %d times\n", s, n, found);
+    exit(1);
+  }
+  n = open("rdpdir/sub/f", O_RDONLY);
+  if(openat(n, "x", O_RDONLY, 0) >= 0){
+    printf("%s: openat relative to a file succeeded\n", s);
+    exit(1);
+  }
+  close(n);
+  close(fd);
+  close(dfd);
+  remove("rdpdir/sub/f");
+  remove("rdpdir/sub");
+  remove("rdpdir");
+}
+
+// the *at calls must resolve relative paths from dirfd even when
+// the cwd is somewhere else, and lookups must follow the changes.
+void
+attest(char *s)
+{
+  int dfd, fd;
+
+  if(mkdir("atdir") < 0 || mkdir("atdir/inner") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  if((dfd = open("atdir", O_RDONLY)) < 0 || chdir("atdir/inner") < 0){
+    printf("%s: open or chdir failed\n", s);
+    exit(1);
+  }
+  if(mkdirat(dfd, "made", 0) < 0 || (fd = openat(dfd, "made/f", O_CREATE|O_RDWR, 0)) < 0){
+    printf("%s: mkdirat or openat failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(open("made", O_RDONLY) >= 0 || open("/atdir/made/f", O_RDONLY) < 0){
+    printf("%s: made in the wrong directory\n", s);
+    exit(1);
+  }
+  if(unlinkat(dfd, "made", AT_REMOVEDIR) == 0){
+    printf("%s: removed a non-empty directory\n", s);
+    exit(1);
+  }
+  if(unlinkat(dfd, "made/f", 0) < 0 || unlinkat(dfd, "made", AT_REMOVEDIR) < 0){
+    printf("%s: unlinkat failed\n", s);
+    exit(1);
+  }
+  if(openat(dfd, "made", O_RDONLY, 0) >= 0 || open("/atdir/made", O_RDONLY) >= 0){
+    printf("%s: removed directory still opens\n", s);
+    exit(1);
+  }
+  close(dfd);
+  if(chdir("/") < 0){
+    printf("%s: chdir / failed\n", s);
+    exit(1);
+  }
+  remove("atdir/inner");
+  remove("atdir");
+}
+
+// data and bss pages are read in or zero-filled on first touch,
+// whether the program or the kernel (a read() into them) gets
+// there first, and a fork child faults in what the parent hadn't.
+char lazydata[3*4096] = { [0] = 'a', [4096] = 'b', [2*4096 + 100] = 'c' };
+char lazybss[4*4096];
+
+void
+lazyexec(char *s)
+{
+  int fds[2], pid, xstatus;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], "xyz", 3) != 3 || read(fds[0], lazydata + 2*4096, 3) != 3){
+    printf("%s: pipe i/o failed\n", s);
+    exit(1);
+  }
+  if(lazydata[2*4096] != 'x' || lazydata[2*4096 + 100] != 'c'){
+    printf("%s: data page read in wrong\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(lazydata[0] != 'a' || lazydata[4096] != 'b' || lazydata[2*4096] != 'x'){
+      printf("%s: child sees wrong data\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < sizeof(lazybss); i += 512)
+      if(lazybss[i] != 0){
+        printf("%s: bss not zero at %d\n", s, i);
+        exit(1);
+      }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  if(write(fds[1], "q", 1) != 1 || read(fds[0], lazybss + 3*4096 + 7, 1) != 1 ||
+     lazybss[3*4096 + 7] != 'q' || lazybss[3*4096] != 0){
+    printf("%s: read into bss failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// text is mapped read-only, being shared with every other process
+// running the program: neither a store nor a read() may change it.
+void
+textro(char *s)
+{
+  int fds[2], pid, xstatus;
+  volatile char *text = (volatile char *)textro;
+  char c = *text;
+
+  if(pipe(fds) < 0 || write(fds[1], "x", 1) != 1){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if(read(fds[0], (char *)text, 1) > 0 || *text != c){
+    printf("%s: read() into text succeeded\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *text = c + 1;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1 || *text != c){
+    printf("%s: store to text was not fatal\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// file data goes through the page cache: reads after a write see
+// it, and so does a read-only mmap() of the file, which maps the
+// cached pages themselves.
+void
+pagecache(char *s)
+{
+  static char buf[2*4096 + 100];
+  int fd, i;
+  char *m;
+
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 23;
+  if((fd = open("pcfile", O_CREATE|O_RDWR)) < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("pcfile", O_RDWR)) < 0){
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  m = mmap(0, sizeof(buf), PROT_READ, 0, fd, 0);
+  if(m == (char *)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < sizeof(buf); i++)
+    if(m[i] != buf[i]){
+      printf("%s: mapping differs at %d\n", s, i);
+      exit(1);
+    }
+  if(m[sizeof(buf)] != 0){
+    printf("%s: mapping not zero past the end\n", s);
+    exit(1);
+  }
+  // a write straddling the first two pages
+  if(read(fd, buf, 4096 - 2) != 4096 - 2 || write(fd, "WXYZ", 4) != 4){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(m[4094] != 'W' || m[4097] != 'Z'){
+    printf("%s: mapping missed the write\n", s);
+    exit(1);
+  }
+  close(fd);
+  if((fd = open("pcfile", O_RDONLY)) < 0 || read(fd, buf, 4096 - 4) != 4096 - 4 ||
+     read(fd, buf, 8) != 8 || buf[1] != m[4093] || buf[2] != 'W' || buf[5] != 'Z'){
+    printf("%s: read missed the write\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(munmap(m, sizeof(buf)) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+  remove("pcfile");
+}
+
+// allocate more memory than is free, so that some of it has to be
+// paged out to swap, and check it all comes back, in a fork child too.
+void
+swapmem(char *s)
+{
+  struct sysinfo info;
+  int pid, xstatus, i, n;
+  char *a;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(sysinfo(&info) < 0){
+      printf("%s: sysinfo failed\n", s);
+      exit(1);
+    }
+    n = info.freemem / PGSIZE + 64;
+    a = sbrk(0);
+    for(i = 0; i < n; i++){
+      if(sbrk(PGSIZE) == (char*)-1){
+        printf("%s: sbrk failed at page %d of %d\n", s, i, n);
+        exit(1);
+      }
+      *(int*)(a + i*PGSIZE) = i;
+      *(int*)(a + i*PGSIZE + PGSIZE - 4) = ~i;
+    }
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork of a swapped process failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < n; i++){
+      if(*(int*)(a + i*PGSIZE) != i || *(int*)(a + i*PGSIZE + PGSIZE - 4) != ~i){
+        printf("%s: page %d lost in %s\n", s, i, pid == 0 ? "child" : "parent");
+        exit(1);
+      }
+    }
+    if(pid == 0)
+      exit(0);
+    wait(&xstatus);
+    exit(xstatus);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -2694,6 +3788,26 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipesize, "pipesize"},
+    {splicetest, "splicetest"},
+    {vectorio, "vectorio"},
+    {ioring, "ioring"},
+    {threadshare, "threadshare"},
+    {futextest, "futextest"},
+    {syscallstattest, "syscallstattest"},
+    {kproftest, "kproftest"},
+    {lockstattest, "lockstattest"},
+    {dcachetest, "dcachetest"},
+    {negdenttest, "negdenttest"},
+    {ecachetest, "ecachetest"},
+    {dirindextest, "dirindextest"},
+    {getdentstest, "getdentstest"},
+    {readdirplustest, "readdirplustest"},
+    {attest, "attest"},
+    {lazyexec, "lazyexec"},
+    {textro, "textro"},
+    {pagecache, "pagecache"},
+    {swapmem, "swapmem"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
@@ -42,3 +42,29 @@ entry("trace");
 entry("sysinfo");
 entry("rename");
 entry("shutdown");
+entry("gettimeofday");
+entry("fcntl");
+entry("splice");
+entry("tee");
+entry("sendfile");
+entry("readv");
+entry("writev");
+entry("pread");
+entry("pwrite");
+entry("preadv");
+entry("pwritev");
+entry("fsync");
+entry("ioring_enter");
+entry("clone");
+entry("futex");
+entry("waitpid");
+entry("syscallstat");
+entry("kprof");
+entry("lockstat");
+entry("getdents");
+entry("readdirplus");
+entry("openat");
+entry("mkdirat");
+entry("unlinkat");
+entry("mmap");
+entry("munmap");